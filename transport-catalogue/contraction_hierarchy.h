@@ -0,0 +1,486 @@
+#pragma once
+
+#include "graph.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <limits>
+#include <optional>
+#include <queue>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace graph {
+
+// Иерархия сжатий (contraction hierarchies): вершины упорядочиваются по важности,
+// при удалении (сжатии) вершины кратчайшие пути через неё сохраняются шорткатами.
+// Запрос - двунаправленный поиск только "вверх" по рангам, хранение - O(E)
+template <typename Weight>
+class ContractionHierarchy {
+public:
+    static constexpr size_t NO_ARC = std::numeric_limits<size_t>::max();
+
+    struct Arc {
+        VertexId from;
+        VertexId to;
+        Weight weight;
+        EdgeId edge_id = 0;       // ребро исходного графа, если дуга не шорткат
+        size_t first = NO_ARC;    // дуги from -> v и v -> to, которые заменяет шорткат
+        size_t second = NO_ARC;
+
+        bool IsShortcut() const {
+            return first != NO_ARC;
+        }
+    };
+
+    struct RouteInfo {
+        Weight weight;
+        std::vector<EdgeId> edges;
+    };
+
+    ContractionHierarchy() = default;
+    template <typename Graph>
+    explicit ContractionHierarchy(const Graph& graph);
+
+    std::optional<RouteInfo> BuildRoute(VertexId from, VertexId to) const;
+
+    // Строит списки дуг для поиска по рангам вершин и списку дуг
+    void BuildSearchIndex();
+
+    const std::vector<size_t>& GetRanks() const {
+        return ranks_;
+    }
+    std::vector<size_t>& GetRanks() {
+        return ranks_;
+    }
+    const std::vector<Arc>& GetArcs() const {
+        return arcs_;
+    }
+    std::vector<Arc>& GetArcs() {
+        return arcs_;
+    }
+
+private:
+    // ограничения поиска свидетеля: при оценке приоритета вершины и при её сжатии.
+    // Не найденный из-за ограничения свидетель лишь добавляет лишний шорткат
+    static constexpr size_t PRIORITY_SETTLE_LIMIT = 10;
+    static constexpr size_t CONTRACTION_SETTLE_LIMIT = 500;
+
+    struct Builder;
+
+    void UnpackArc(size_t arc_id, std::vector<EdgeId>& edges) const;
+
+    std::vector<size_t> ranks_;
+    std::vector<Arc> arcs_;
+
+    std::vector<size_t> up_offsets_;    // дуги из вершины в вершины большего ранга
+    std::vector<size_t> up_arcs_;
+    std::vector<size_t> down_offsets_;  // дуги в вершину из вершин большего ранга
+    std::vector<size_t> down_arcs_;
+};
+
+template <typename Weight>
+struct ContractionHierarchy<Weight>::Builder {
+    using QueueItem = std::pair<Weight, VertexId>;
+
+    struct Greater {
+        bool operator()(const QueueItem& lhs, const QueueItem& rhs) const {
+            return lhs.first > rhs.first;
+        }
+    };
+
+    explicit Builder(ContractionHierarchy& hierarchy, size_t vertex_count)
+        : ch(hierarchy)
+        , out_arcs(vertex_count)
+        , in_arcs(vertex_count)
+        , contracted(vertex_count, false)
+        , deleted_neighbours(vertex_count, 0)
+        , witness_weights(vertex_count)
+        , is_target(vertex_count, false) {
+    }
+
+    void AddArc(Arc arc) {
+        const size_t arc_id = ch.arcs_.size();
+        out_arcs[arc.from].push_back(arc_id);
+        in_arcs[arc.to].push_back(arc_id);
+        ch.arcs_.push_back(std::move(arc));
+    }
+
+    // Ищет пути из from в отмеченные is_target вершины, не проходящие через excluded
+    // и не тяжелее limit
+    void RunWitnessSearch(VertexId from, VertexId excluded, const Weight& limit,
+                          size_t targets_count, size_t settle_limit) {
+        for (const VertexId vertex : touched) {
+            witness_weights[vertex].reset();
+        }
+        touched.clear();
+
+        std::priority_queue<QueueItem, std::vector<QueueItem>, Greater> queue;
+        witness_weights[from] = Weight{};
+        touched.push_back(from);
+        queue.push({Weight{}, from});
+
+        size_t settled = 0;
+        while (!queue.empty() && settled < settle_limit && targets_count > 0) {
+            const auto [weight, vertex] = queue.top();
+            queue.pop();
+
+            if (*witness_weights[vertex] < weight) {
+                continue;
+            }
+            if (limit < weight) {
+                break;
+            }
+            ++settled;
+            if (is_target[vertex]) {
+                --targets_count;
+            }
+
+            for (const size_t arc_id : out_arcs[vertex]) {
+                const Arc& arc = ch.arcs_[arc_id];
+                if (contracted[arc.to] || arc.to == excluded) {
+                    continue;
+                }
+
+                const Weight candidate = weight + arc.weight;
+                auto& target_weight = witness_weights[arc.to];
+                if (!target_weight) {
+                    touched.push_back(arc.to);
+                }
+                if (!target_weight || candidate < *target_weight) {
+                    target_weight = candidate;
+                    queue.push({candidate, arc.to});
+                }
+            }
+        }
+    }
+
+    // Возвращает число шорткатов, нужных для сжатия вершины, и при add добавляет их
+    int ProcessShortcuts(VertexId vertex, bool add) {
+        int shortcuts = 0;
+
+        for (size_t in_index = 0; in_index < in_arcs[vertex].size(); ++in_index) {
+            const size_t in_arc_id = in_arcs[vertex][in_index];
+            const VertexId source = ch.arcs_[in_arc_id].from;
+            if (contracted[source] || source == vertex) {
+                continue;
+            }
+
+            std::optional<Weight> limit;
+            size_t targets_count = 0;
+            for (const size_t out_arc_id : out_arcs[vertex]) {
+                const Arc& out_arc = ch.arcs_[out_arc_id];
+                if (contracted[out_arc.to] || out_arc.to == source || out_arc.to == vertex) {
+                    continue;
+                }
+                const Weight through = ch.arcs_[in_arc_id].weight + out_arc.weight;
+                if (!limit || *limit < through) {
+                    limit = through;
+                }
+                if (!is_target[out_arc.to]) {
+                    is_target[out_arc.to] = true;
+                    ++targets_count;
+                }
+            }
+            if (!limit) {
+                continue;
+            }
+
+            RunWitnessSearch(source, vertex, *limit, targets_count,
+                             add ? CONTRACTION_SETTLE_LIMIT : PRIORITY_SETTLE_LIMIT);
+
+            for (const size_t out_arc_id : out_arcs[vertex]) {
+                is_target[ch.arcs_[out_arc_id].to] = false;
+            }
+
+            for (size_t out_index = 0; out_index < out_arcs[vertex].size(); ++out_index) {
+                const size_t out_arc_id = out_arcs[vertex][out_index];
+                const VertexId target = ch.arcs_[out_arc_id].to;
+                if (contracted[target] || target == source || target == vertex) {
+                    continue;
+                }
+
+                const Weight through = ch.arcs_[in_arc_id].weight + ch.arcs_[out_arc_id].weight;
+                const auto& witness = witness_weights[target];
+                if (witness && !(through < *witness)) {
+                    continue;
+                }
+
+                ++shortcuts;
+                if (add) {
+                    AddArc(Arc{source, target, through, 0, in_arc_id, out_arc_id});
+                }
+            }
+        }
+
+        return shortcuts;
+    }
+
+    int ComputePriority(VertexId vertex) {
+        int removed_arcs = 0;
+        for (const size_t arc_id : in_arcs[vertex]) {
+            removed_arcs += contracted[ch.arcs_[arc_id].from] ? 0 : 1;
+        }
+        for (const size_t arc_id : out_arcs[vertex]) {
+            removed_arcs += contracted[ch.arcs_[arc_id].to] ? 0 : 1;
+        }
+
+        return ProcessShortcuts(vertex, false) - removed_arcs + deleted_neighbours[vertex];
+    }
+
+    void Contract(VertexId vertex, size_t rank) {
+        ProcessShortcuts(vertex, true);
+        contracted[vertex] = true;
+        ch.ranks_[vertex] = rank;
+
+        // дуги в сжатую вершину больше не участвуют в поиске свидетелей
+        for (const size_t arc_id : in_arcs[vertex]) {
+            const VertexId source = ch.arcs_[arc_id].from;
+            ++deleted_neighbours[source];
+            EraseArcs(out_arcs[source], [&](const Arc& arc) { return arc.to == vertex; });
+        }
+        for (const size_t arc_id : out_arcs[vertex]) {
+            const VertexId target = ch.arcs_[arc_id].to;
+            ++deleted_neighbours[target];
+            EraseArcs(in_arcs[target], [&](const Arc& arc) { return arc.from == vertex; });
+        }
+    }
+
+    template <typename Predicate>
+    void EraseArcs(std::vector<size_t>& arc_ids, Predicate predicate) {
+        arc_ids.erase(std::remove_if(arc_ids.begin(), arc_ids.end(),
+                                     [&](size_t arc_id) { return predicate(ch.arcs_[arc_id]); }),
+                      arc_ids.end());
+    }
+
+    ContractionHierarchy& ch;
+    std::vector<std::vector<size_t>> out_arcs;
+    std::vector<std::vector<size_t>> in_arcs;
+    std::vector<bool> contracted;
+    std::vector<int> deleted_neighbours;
+    std::vector<std::optional<Weight>> witness_weights;
+    std::vector<VertexId> touched;
+    std::vector<bool> is_target;
+};
+
+template <typename Weight>
+template <typename Graph>
+ContractionHierarchy<Weight>::ContractionHierarchy(const Graph& graph) {
+    const size_t vertex_count = graph.GetVertexCount();
+    ranks_.assign(vertex_count, 0);
+
+    Builder builder(*this, vertex_count);
+
+    // из параллельных рёбер в иерархию попадает только самое лёгкое
+    std::vector<size_t> best_arc(vertex_count, NO_ARC);
+    for (VertexId vertex = 0; vertex < vertex_count; ++vertex) {
+        std::vector<VertexId> targets;
+
+        for (const EdgeId edge_id : graph.GetIncidentEdges(vertex)) {
+            const auto& edge = graph.GetEdge(edge_id);
+            if (edge.weight < Weight{}) {
+                throw std::domain_error("Edges' weights should be non-negative");
+            }
+            if (edge.to == vertex) {
+                continue;
+            }
+
+            size_t& arc_id = best_arc[edge.to];
+            if (arc_id == NO_ARC) {
+                arc_id = arcs_.size();
+                targets.push_back(edge.to);
+                builder.AddArc(Arc{edge.from, edge.to, edge.weight, edge_id});
+            } else if (edge.weight < arcs_[arc_id].weight) {
+                arcs_[arc_id].weight = edge.weight;
+                arcs_[arc_id].edge_id = edge_id;
+            }
+        }
+
+        for (const VertexId target : targets) {
+            best_arc[target] = NO_ARC;
+        }
+    }
+
+    using PriorityItem = std::pair<int, VertexId>;
+    std::priority_queue<PriorityItem, std::vector<PriorityItem>, std::greater<PriorityItem>> queue;
+    for (VertexId vertex = 0; vertex < vertex_count; ++vertex) {
+        queue.push({builder.ComputePriority(vertex), vertex});
+    }
+
+    size_t rank = 0;
+    while (!queue.empty()) {
+        const VertexId vertex = queue.top().second;
+        queue.pop();
+
+        // ленивое обновление: приоритет пересчитывается перед сжатием
+        const int priority = builder.ComputePriority(vertex);
+        if (!queue.empty() && priority > queue.top().first) {
+            queue.push({priority, vertex});
+            continue;
+        }
+
+        builder.Contract(vertex, rank++);
+    }
+
+    BuildSearchIndex();
+}
+
+template <typename Weight>
+void ContractionHierarchy<Weight>::BuildSearchIndex() {
+    const size_t vertex_count = ranks_.size();
+
+    up_offsets_.assign(vertex_count + 1, 0);
+    down_offsets_.assign(vertex_count + 1, 0);
+
+    for (const Arc& arc : arcs_) {
+        if (ranks_.at(arc.from) < ranks_.at(arc.to)) {
+            ++up_offsets_[arc.from + 1];
+        } else {
+            ++down_offsets_[arc.to + 1];
+        }
+    }
+    for (VertexId vertex = 0; vertex < vertex_count; ++vertex) {
+        up_offsets_[vertex + 1] += up_offsets_[vertex];
+        down_offsets_[vertex + 1] += down_offsets_[vertex];
+    }
+
+    up_arcs_.assign(up_offsets_.back(), NO_ARC);
+    down_arcs_.assign(down_offsets_.back(), NO_ARC);
+
+    std::vector<size_t> up_positions(up_offsets_.begin(), up_offsets_.end() - 1);
+    std::vector<size_t> down_positions(down_offsets_.begin(), down_offsets_.end() - 1);
+
+    for (size_t arc_id = 0; arc_id < arcs_.size(); ++arc_id) {
+        const Arc& arc = arcs_[arc_id];
+        if (ranks_[arc.from] < ranks_[arc.to]) {
+            up_arcs_[up_positions[arc.from]++] = arc_id;
+        } else {
+            down_arcs_[down_positions[arc.to]++] = arc_id;
+        }
+    }
+}
+
+template <typename Weight>
+std::optional<typename ContractionHierarchy<Weight>::RouteInfo>
+ContractionHierarchy<Weight>::BuildRoute(VertexId from, VertexId to) const {
+    const size_t vertex_count = ranks_.size();
+    if (from >= vertex_count || to >= vertex_count) {
+        throw std::out_of_range("Vertex id is out of range");
+    }
+
+    if (from == to) {
+        return RouteInfo{Weight{}, {}};
+    }
+
+    using QueueItem = std::pair<Weight, VertexId>;
+    auto greater = [](const QueueItem& lhs, const QueueItem& rhs) {
+        return lhs.first > rhs.first;
+    };
+    using Queue = std::priority_queue<QueueItem, std::vector<QueueItem>, decltype(greater)>;
+
+    // 0 - прямой поиск из from, 1 - обратный поиск из to
+    Queue queues[2] = {Queue(greater), Queue(greater)};
+    std::vector<std::optional<Weight>> weights[2] = {
+        std::vector<std::optional<Weight>>(vertex_count),
+        std::vector<std::optional<Weight>>(vertex_count)};
+    std::vector<size_t> prev_arcs[2] = {
+        std::vector<size_t>(vertex_count, NO_ARC),
+        std::vector<size_t>(vertex_count, NO_ARC)};
+
+    weights[0][from] = Weight{};
+    weights[1][to] = Weight{};
+    queues[0].push({Weight{}, from});
+    queues[1].push({Weight{}, to});
+
+    std::optional<Weight> best_weight;
+    VertexId meeting_vertex = 0;
+
+    auto update_best = [&](VertexId vertex) {
+        if (weights[0][vertex] && weights[1][vertex]) {
+            const Weight candidate = *weights[0][vertex] + *weights[1][vertex];
+            if (!best_weight || candidate < *best_weight) {
+                best_weight = candidate;
+                meeting_vertex = vertex;
+            }
+        }
+    };
+
+    auto is_finished = [&](int direction) {
+        return queues[direction].empty()
+            || (best_weight && !(queues[direction].top().first < *best_weight));
+    };
+
+    while (!is_finished(0) || !is_finished(1)) {
+        int direction = is_finished(0) ? 1 : 0;
+        if (!is_finished(0) && !is_finished(1)
+            && queues[1].top().first < queues[0].top().first) {
+            direction = 1;
+        }
+
+        const auto [weight, vertex] = queues[direction].top();
+        queues[direction].pop();
+
+        if (*weights[direction][vertex] < weight) {
+            continue;
+        }
+
+        const auto& offsets = direction == 0 ? up_offsets_ : down_offsets_;
+        const auto& arc_ids = direction == 0 ? up_arcs_ : down_arcs_;
+
+        for (size_t i = offsets[vertex]; i < offsets[vertex + 1]; ++i) {
+            const Arc& arc = arcs_[arc_ids[i]];
+            const VertexId next = direction == 0 ? arc.to : arc.from;
+            const Weight candidate = weight + arc.weight;
+
+            auto& next_weight = weights[direction][next];
+            if (!next_weight || candidate < *next_weight) {
+                next_weight = candidate;
+                prev_arcs[direction][next] = arc_ids[i];
+                queues[direction].push({candidate, next});
+                update_best(next);
+            }
+        }
+    }
+
+    if (!best_weight) {
+        return std::nullopt;
+    }
+
+    std::vector<size_t> path_arcs;
+    for (VertexId vertex = meeting_vertex; prev_arcs[0][vertex] != NO_ARC;
+         vertex = arcs_[prev_arcs[0][vertex]].from) {
+        path_arcs.push_back(prev_arcs[0][vertex]);
+    }
+    std::reverse(path_arcs.begin(), path_arcs.end());
+    for (VertexId vertex = meeting_vertex; prev_arcs[1][vertex] != NO_ARC;
+         vertex = arcs_[prev_arcs[1][vertex]].to) {
+        path_arcs.push_back(prev_arcs[1][vertex]);
+    }
+
+    std::vector<EdgeId> edges;
+    for (const size_t arc_id : path_arcs) {
+        UnpackArc(arc_id, edges);
+    }
+
+    return RouteInfo{*best_weight, std::move(edges)};
+}
+
+template <typename Weight>
+void ContractionHierarchy<Weight>::UnpackArc(size_t arc_id, std::vector<EdgeId>& edges) const {
+    std::vector<size_t> stack{arc_id};
+
+    while (!stack.empty()) {
+        const Arc& arc = arcs_[stack.back()];
+        stack.pop_back();
+
+        if (arc.IsShortcut()) {
+            stack.push_back(arc.second);
+            stack.push_back(arc.first);
+        } else {
+            edges.push_back(arc.edge_id);
+        }
+    }
+}
+
+}  // namespace graph
@@ -12,15 +12,20 @@
  *
  */
 
+#include <cstdint>
 #include <string>
+#include <string_view>
 #include <unordered_map>
-#include <set>
 #include <vector>
 
 #include "geo.h"
 
 namespace transport {
 
+// Плотные номера остановок и маршрутов: порядок добавления в справочник, начиная с 0
+using StopId = uint32_t;
+using BusId = uint32_t;
+
 struct BusStat {
     int all_stops;
     int unique_stops;
@@ -28,17 +33,19 @@ struct BusStat {
     double curvature;
 };
 
+// Названия хранятся в пуле строк справочника и живут, пока жив справочник
 struct Stop {
-    std::string name;
+    std::string_view name;
     geo::Coordinates coordinates;
-    std::set<std::string_view> buses_through;
-    int id;
+    std::vector<std::string_view> buses_through; // отсортированы после TransportCatalogue::Freeze
+    StopId id;
 };
 
 struct Bus {
-    std::string name;
+    std::string_view name;
     std::vector<Stop*> bus_stops;
     bool circular;
+    BusId id;
 };
 
 namespace parsed {
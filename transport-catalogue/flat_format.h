@@ -0,0 +1,114 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <type_traits>
+
+#include "ranges.h"
+
+// Плоский формат базы: заголовок с таблицей секций и секции из массивов записей
+// фиксированного размера. Файл отображается в память, и таблица маршрутов читается
+// прямо из отображения. Порядок байт - как у машины, собравшей базу
+namespace serialize::flat {
+
+inline constexpr char MAGIC[8] = {'T', 'C', 'F', 'L', 'A', 'T', '\0', '\1'};
+inline constexpr uint32_t VERSION = 2;
+inline constexpr uint64_t SECTION_ALIGNMENT = 8;
+
+enum class Section : uint32_t {
+    META,              // protobuf TransportCatalogue без справочника, графа и таблиц
+    STRINGS,           // названия остановок и маршрутов подряд
+    STOPS,             // Stop, индекс - id остановки
+    BUSES,             // Bus, индекс - id маршрута в рёбрах графа
+    BUS_STOPS,         // uint32_t id остановок маршрутов
+    DISTANCES,         // Distance
+    EDGES,             // Edge
+    ROUTES_WEIGHTS,    // double, таблица всех пар построчно
+    ROUTES_PREV_EDGES, // uint32_t, таблица всех пар построчно
+    HIERARCHY_RANKS,   // uint32_t
+    HIERARCHY_ARCS,    // Arc
+    COUNT,
+};
+
+struct SectionRange {
+    uint64_t offset;
+    uint64_t size;
+};
+
+struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t sections_count;
+    SectionRange sections[static_cast<size_t>(Section::COUNT)];
+};
+
+struct String {
+    uint32_t offset;
+    uint32_t size;
+};
+
+struct Stop {
+    String name;
+    double lat;
+    double lng;
+};
+
+struct Bus {
+    String name;
+    uint32_t first_stop;
+    uint32_t stops_count;
+    uint32_t circular;
+    // статистика маршрута, посчитанная при make_base
+    int32_t all_stops;
+    int32_t unique_stops;
+    uint32_t length;
+    double curvature;
+};
+
+struct Distance {
+    uint32_t from;
+    uint32_t to;
+    int32_t length;
+};
+
+struct Edge {
+    uint32_t from;
+    uint32_t to;
+    uint32_t bus_id;
+    int32_t span_count;
+    double total_time;
+};
+
+// Для шортката first и second - номера заменяемых дуг, иначе edge_id - ребро графа
+struct Arc {
+    uint32_t from;
+    uint32_t to;
+    uint32_t edge_id;
+    uint32_t first;
+    uint32_t second;
+    uint32_t padding;
+    double total_time;
+};
+
+inline constexpr uint32_t NO_ARC = UINT32_MAX;
+
+inline bool HasFlatHeader(const char* data, size_t size) {
+    return size >= sizeof(Header) && std::memcmp(data, MAGIC, sizeof(MAGIC)) == 0;
+}
+
+// Массив записей секции. Границы секций проверяются при чтении заголовка
+template <typename T>
+ranges::Range<const T*> GetSection(const char* data, const Header& header, Section section) {
+    static_assert(std::is_trivially_copyable_v<T>);
+
+    const auto& range = header.sections[static_cast<size_t>(section)];
+    if (range.size % sizeof(T) != 0) {
+        throw std::runtime_error("Broken section in the flat base file");
+    }
+
+    const T* begin = reinterpret_cast<const T*>(data + range.offset);
+    return {begin, begin + range.size / sizeof(T)};
+}
+
+} // serialize::flat
@@ -100,4 +100,90 @@ DirectedWeightedGraph<Weight>::GetIncidenceLists() const {
     return incidence_lists_;
 }
 
+// Неизменяемый граф в формате CSR: рёбра упорядочены по исходящей вершине
+// и лежат в одном массиве, поэтому рёбра вершины v имеют id из [offsets[v], offsets[v + 1])
+template <typename Weight>
+class FrozenDirectedWeightedGraph {
+public:
+
+    using IncidentEdgesRange = ranges::Range<ranges::CountingIterator<EdgeId>>;
+
+
+    FrozenDirectedWeightedGraph() = default;
+    explicit FrozenDirectedWeightedGraph(const DirectedWeightedGraph<Weight>& graph);
+    FrozenDirectedWeightedGraph(size_t vertex_count, std::vector<Edge<Weight>> edges);
+
+    size_t GetVertexCount() const;
+    size_t GetEdgeCount() const;
+    const Edge<Weight>& GetEdge(EdgeId edge_id) const;
+    IncidentEdgesRange GetIncidentEdges(VertexId vertex) const;
+
+    const std::vector<Edge<Weight>>& GetEdges() const;
+
+private:
+    std::vector<Edge<Weight>> edges_;
+    std::vector<EdgeId> offsets_;
+};
+
+template <typename Weight>
+FrozenDirectedWeightedGraph<Weight>::FrozenDirectedWeightedGraph(const DirectedWeightedGraph<Weight>& graph)
+    : offsets_(graph.GetVertexCount() + 1, 0) {
+
+    edges_.reserve(graph.GetEdgeCount());
+
+    for (VertexId vertex = 0; vertex < graph.GetVertexCount(); ++vertex) {
+        for (EdgeId edge_id : graph.GetIncidentEdges(vertex)) {
+            edges_.push_back(graph.GetEdge(edge_id));
+        }
+        offsets_[vertex + 1] = edges_.size();
+    }
+}
+
+template <typename Weight>
+FrozenDirectedWeightedGraph<Weight>::FrozenDirectedWeightedGraph(size_t vertex_count,
+                                                                 std::vector<Edge<Weight>> edges)
+    : offsets_(vertex_count + 1, 0) {
+
+    for (const auto& edge : edges) {
+        ++offsets_.at(edge.from + 1);
+    }
+    for (VertexId vertex = 0; vertex < vertex_count; ++vertex) {
+        offsets_[vertex + 1] += offsets_[vertex];
+    }
+
+    // устойчивая сортировка подсчётом: порядок рёбер одной вершины сохраняется
+    std::vector<EdgeId> positions(offsets_.begin(), offsets_.end() - 1);
+    edges_.resize(edges.size());
+    for (auto& edge : edges) {
+        const VertexId from = edge.from;
+        edges_[positions[from]++] = std::move(edge);
+    }
+}
+
+template <typename Weight>
+size_t FrozenDirectedWeightedGraph<Weight>::GetVertexCount() const {
+    return offsets_.empty() ? 0 : offsets_.size() - 1;
+}
+
+template <typename Weight>
+size_t FrozenDirectedWeightedGraph<Weight>::GetEdgeCount() const {
+    return edges_.size();
+}
+
+template <typename Weight>
+const Edge<Weight>& FrozenDirectedWeightedGraph<Weight>::GetEdge(EdgeId edge_id) const {
+    return edges_.at(edge_id);
+}
+
+template <typename Weight>
+typename FrozenDirectedWeightedGraph<Weight>::IncidentEdgesRange
+FrozenDirectedWeightedGraph<Weight>::GetIncidentEdges(VertexId vertex) const {
+    return ranges::AsCountingRange(offsets_.at(vertex), offsets_.at(vertex + 1));
+}
+
+template<typename Weight>
+const std::vector<Edge<Weight>>& FrozenDirectedWeightedGraph<Weight>::GetEdges() const {
+    return edges_;
+}
+
 }  // namespace graph
\ No newline at end of file
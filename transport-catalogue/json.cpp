@@ -1,5 +1,6 @@
-#include <sstream>
-#include <iomanip>
+#include <charconv>
+#include <cstring>
+#include <deque>
 
 #include "json.h"
 
@@ -9,258 +10,267 @@ namespace json {
 
 namespace {
 
-Node LoadNode(istream& input);
-    
-Node LoadArray(istream& input) {
-    Array result;
-    char c;
-
-    while (input >> c) {
-        if ( c == ']') {
-            break;
-        }
-        
-        if (c != ',') {
-            input.putback(c);
-        }
-        
-        result.push_back(LoadNode(input));
+// Числа разбираются через from_chars: без копирования лексемы и без зависимости от локали.
+// Лексема должна быть числом целиком
+JsonValue LexemeToValue(string_view lex) {
+    if (lex == "null"sv) {
+        return nullptr;
     }
     
-    if (c != ']') {
-        throw ParsingError{"no closing bracket in array"s};
+    if (lex == "true"sv) {
+        return true;
     }
     
-    return Node(move(result));
-}
-
-string LoadLexeme(istream& input) {
-    stringstream dst;
-    char c;
-    
-    while (input.peek() != '}' 
-        && input.peek() != ']' 
-        && input.peek() != ' '
-        && input.peek() != ','
-        && input.peek() != '\r'
-        && input.peek() != '\n'
-        && input.peek() != '\t'
-        && input.peek() != EOF) {
-        
-        c = input.get();
-        dst << c;
+    if (lex == "false"sv) {
+        return false;
     }
+
+    const char* begin = lex.data();
+    const char* end = lex.data() + lex.size();
     
-    return dst.str();
-}
-    
-Node LexemeToNode(const string& lex) {
-    if (lex == "null"s) {
-        return Node{nullptr};
-    }
-    
-    if (lex == "true"s) {
-        return Node{true};
-    }
-    
-    if (lex == "false"s) {
-        return  Node{false};
-    }
-    
-    bool is_double = false;
-    double double_res;
-    
-    if (lex.find('.') != lex.npos 
-        || lex.find('E') != lex.npos 
-        || lex.find('e') != lex.npos) {
-        
-        try {
-            double_res = stod(lex);
-            is_double = true;
-        } catch (...) {
+    if (lex.find_first_of(".eE"sv) != lex.npos) {
+        double double_res;
+        auto [ptr, ec] = from_chars(begin, end, double_res);
+
+        if (ec != errc() || ptr != end) {
             throw ParsingError{"undefined lexeme"s};
         }
-    }
-    
-    if (is_double) {
-        return Node{double_res};
+        return double_res;
     }
     
     int int_res;
-    
-    try {
-        int_res = stoi(lex);
-    } catch (...) {
+    auto [ptr, ec] = from_chars(begin, end, int_res);
+
+    if (ec != errc() || ptr != end) {
         throw ParsingError{"undefined lexeme"s};
     }
-    
-    return Node{int_res};
+    return int_res;
 }
 
-Node LoadString(istream& input) {
-    
-    stringstream dst;
-    bool escape = false;
-    char c;
-    
-    while (input.peek() != '"' || escape) {
-        c = input.get();
-        
-        if (input.eof()) {
-            throw ParsingError{"no ending quote in string"s};
-        }
-        
-        if (c == '\\' && !escape) {
-            escape = true;
-            continue;
+Node LexemeToNode(string_view lex) {
+    return visit([](auto&& value) { return Node(move(value)); }, LexemeToValue(lex));
+}
+
+string ReadAll(istream& input) {
+    string data;
+    char buffer[1 << 16];
+
+    while (input.read(buffer, sizeof(buffer)) || input.gcount() > 0) {
+        data.append(buffer, static_cast<size_t>(input.gcount()));
+    }
+
+    return data;
+}
+
+// Разбор идёт по буферу со всем входом: строки ищутся через memchr,
+// остальные лексемы - сдвигом указателя, без посимвольного чтения из потока
+class Parser {
+public:
+    Parser(const char* begin, const char* end,
+        std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+        : pos_(begin)
+        , end_(end)
+        , resource_(resource) {
+    }
+
+    Node LoadNode() {
+        char c;
+        if (!NextChar(c)) {
+            throw ParsingError{"unexpected end of input"s};
         }
-        
-        if (escape && c == 'n') {
-            dst << '\n';
-        } else if (escape && c == 'r') {
-            dst << '\r';
-        } else if (escape && c == 't') {
-            dst << '\t';
-        } else if (escape && c == '"') {
-            dst << '"';
-        } else if (escape && c == '\\') {
-            dst << '\\';
+
+        if (c == '[') {
+            return LoadArray();
+        } else if (c == '{') {
+            return LoadDict();
+        } else if (c == '"') {
+            return Node(LoadString());
         } else {
-            if (escape) {
-               throw ParsingError{"wrong escape sequence"s};
-            }
-            
-            dst <<  c;
+            --pos_;
+            return LexemeToNode(LoadLexeme());
         }
-        
-        escape = false;
     }
-    
-    input.get(); //remove closing quote 
-    
-    return Node(move(dst.str()));
-}
-
-Node LoadDict(istream& input) {
-    Dict result;
-    char c;
 
-    while (input >> c) {
-        if (c == '}') {
-            break;
+    // Тот же разбор, но значения передаются обработчику событиями
+    void LoadEvents(Handler& handler) {
+        char c;
+        if (!NextChar(c)) {
+            throw ParsingError{"unexpected end of input"s};
         }
-        
-        if (c == ',') {
-            input >> c;
+
+        if (c == '[') {
+            handler.StartArray();
+
+            while (NextChar(c)) {
+                if (c == ']') {
+                    break;
+                }
+                if (c != ',') {
+                    --pos_;
+                }
+                LoadEvents(handler);
+            }
+
+            if (c != ']') {
+                throw ParsingError{"no closing bracket in array"s};
+            }
+
+            handler.EndArray();
+        } else if (c == '{') {
+            handler.StartDict();
+
+            while (NextChar(c)) {
+                if (c == '}') {
+                    break;
+                }
+                if (c == ',') {
+                    NextChar(c);
+                }
+                handler.Key(LoadString());
+                NextChar(c);
+                LoadEvents(handler);
+            }
+
+            if (c != '}') {
+                throw ParsingError{"no closing bracket in dict"s};
+            }
+
+            handler.EndDict();
+        } else if (c == '"') {
+            handler.Value(LoadString());
+        } else {
+            --pos_;
+            handler.Value(LexemeToValue(LoadLexeme()));
         }
+    }
 
-        string key = LoadString(input).AsString();
-        input >> c;
-        result.insert({move(key), LoadNode(input)});
+private:
+    static bool IsSpace(char c) {
+        return c == ' ' || c == '\n' || c == '\r' || c == '\t' || c == '\v' || c == '\f';
     }
-    
-    if (c !=  '}') {
-        throw ParsingError{"no closing bracket in dict"s};
+
+    static bool IsLexemeEnd(char c) {
+        return c == '}' || c == ']' || c == ' ' || c == ','
+            || c == '\r' || c == '\n' || c == '\t';
     }
 
-    return Node(move(result));
-}
+    // Пропускает пробельные символы и читает следующий, как input >> c
+    bool NextChar(char& c) {
+        while (pos_ != end_ && IsSpace(*pos_)) {
+            ++pos_;
+        }
+        if (pos_ == end_) {
+            return false;
+        }
+        c = *pos_++;
+        return true;
+    }
 
-Node LoadNode(istream& input) {
-    char c;
-    input >> c;
+    Node LoadArray() {
+        Array result(resource_);
+        char c = '\0';
 
-    if (c == '[') {
-        return LoadArray(input);
-    } else if (c == '{') {
-        return LoadDict(input);
-    } else if (c == '"') {
-        return LoadString(input);
-    } else {
-        input.putback(c);
-        return LexemeToNode(LoadLexeme(input));
-    }
-}
-    
-std::string escape(std::string_view src) {
-    std::stringstream dst;
-    for (char ch : src) {
-        switch (ch) {
-            case '\n': dst << '\\' << 'n'; break;
-            case '\r': dst << '\\' << 'r'; break;
-            case '"': dst << '\\' << '"'; break;
-            case '\\': dst << '\\' << '\\'; break;
-            default: dst << ch; break;
+        while (NextChar(c)) {
+            if (c == ']') {
+                break;
+            }
+
+            if (c != ',') {
+                --pos_;
+            }
+
+            result.push_back(LoadNode());
+        }
+
+        if (c != ']') {
+            throw ParsingError{"no closing bracket in array"s};
         }
+
+        return Node(move(result));
     }
-    return dst.str();
-}
-    
-void PrintArray(const Array& arr, std::ostream& output, 
-    int indent_size, int indent_step) {
-    
-    output << "[\n"s;
-        
-    size_t index = 0;
-        
-    for (const Node& node : arr) {
-        for (int i = 0; i < indent_size * indent_step; ++i) {
-            output << ' '; 
+
+    // Пары сначала копятся в буфере своего уровня вложенности, буферы переиспользуются,
+    // а в словарь переносятся одним выделением памяти
+    Node LoadDict() {
+        if (dict_depth_ == dict_items_.size()) {
+            dict_items_.emplace_back();
         }
+        auto& items = dict_items_[dict_depth_++];
+        char c = '\0';
+
+        while (NextChar(c)) {
+            if (c == '}') {
+                break;
+            }
 
-        Print(Document{node},  
-              output, 
-              indent_size, 
-              indent_step + 1);
+            if (c == ',') {
+                NextChar(c);
+            }
 
-        if (index < arr.size() - 1) {
-            output << ',';
+            string key = LoadString();
+            NextChar(c);
+            Node value = LoadNode();
+            items.emplace_back(move(key), move(value));
         }
 
-        output << '\n';
-        ++index;
-    }
-        
-    for (int i = 0; i < indent_size * (indent_step - 1); ++i) {
-        output << ' '; 
-    }
-    
-    output << ']';
-}
-    
-void PrintDict(const Dict& dict, std::ostream& output, 
-    int indent_size, int indent_step) {
-    
-    output << "{\n"s;
-        
-    size_t index = 0;
-        
-    for (const auto& [key, node] : dict) {
-        for (int i = 0; i < indent_size * indent_step; ++i) {
-            output << ' '; 
+        if (c != '}') {
+            throw ParsingError{"no closing bracket in dict"s};
         }
-        
-        output << '"' << key << '"' << ": ";
 
-        Print(Document{node},  
-              output, 
-              indent_size, 
-              indent_step + 1);
+        Dict result(resource_);
+        result.Assign(make_move_iterator(items.begin()), make_move_iterator(items.end()));
+        items.clear();
+        --dict_depth_;
 
-        if (index < dict.size() - 1) {
-            output << ',';
-        }
+        return Node(move(result));
+    }
+
+    // Вызывается после открывающей кавычки. Участки без экранирования копируются целиком
+    string LoadString() {
+        string result;
 
-        output << '\n';
-        ++index;
+        while (true) {
+            const char* quote = static_cast<const char*>(memchr(pos_, '"', end_ - pos_));
+            if (!quote) {
+                throw ParsingError{"no ending quote in string"s};
+            }
+
+            const char* backslash = static_cast<const char*>(memchr(pos_, '\\', quote - pos_));
+            if (!backslash) {
+                result.append(pos_, quote);
+                pos_ = quote + 1;
+                return result;
+            }
+
+            result.append(pos_, backslash);
+
+            switch (backslash[1]) {
+                case 'n': result += '\n'; break;
+                case 'r': result += '\r'; break;
+                case 't': result += '\t'; break;
+                case '"': result += '"'; break;
+                case '\\': result += '\\'; break;
+                default: throw ParsingError{"wrong escape sequence"s};
+            }
+
+            pos_ = backslash + 2;
+        }
     }
-        
-    for (int i = 0; i < indent_size * (indent_step - 1); ++i) {
-        output << ' '; 
+
+    string_view LoadLexeme() {
+        const char* begin = pos_;
+        while (pos_ != end_ && !IsLexemeEnd(*pos_)) {
+            ++pos_;
+        }
+        return string_view(begin, pos_ - begin);
     }
-    
-    output << '}';
-}
+
+    const char* pos_;
+    const char* end_;
+    std::pmr::memory_resource* resource_;
+    std::deque<std::vector<Dict::value_type>> dict_items_;
+    size_t dict_depth_ = 0;
+};
 
 }  // namespace
 
@@ -363,8 +373,20 @@ const Node& Document::GetRoot() const {
     return root_;
 }
 
-Document Load(istream& input) {
-    return Document{LoadNode(input)};
+Document Load(string_view input, std::pmr::memory_resource* resource) {
+    return Document{Parser(input.data(), input.data() + input.size(), resource).LoadNode()};
+}
+
+Document Load(istream& input, std::pmr::memory_resource* resource) {
+    return Load(string_view(ReadAll(input)), resource);
+}
+
+void Parse(string_view input, Handler& handler) {
+    Parser(input.data(), input.data() + input.size()).LoadEvents(handler);
+}
+
+void Parse(istream& input, Handler& handler) {
+    Parse(string_view(ReadAll(input)), handler);
 }
 
 bool Document::operator==(const Document& rhs ) const {
@@ -378,25 +400,221 @@ bool Document::operator!=(const Document& rhs ) const {
 void Print(const Document& doc, std::ostream& output, 
     int indent_size, int indent_step) {
 
-    const Node& root = doc.GetRoot();
-    
-    if (root.IsNull()) {
-        output << "null"s;
-    } else if (root.IsString()) {
-        output << '"' << escape(root.AsString()) << '"';
-    } else if (root.IsInt()) {
-        output << root.AsInt();
-    } else if (root.IsDouble()) {
-        output << root.AsDouble();
-    } else if (root.IsBool()) {
-        output << boolalpha << root.AsBool();
-    } else if (root.IsArray()) {
-        const Array& arr = root.AsArray();
-        PrintArray(arr, output, indent_size, indent_step);
-    } else if (root.IsDict()) {
-        const Dict& dict = root.AsDict();
-        PrintDict(dict, output, indent_size, indent_step);
-    }
-}
-
-}  // namespace json
\ No newline at end of file
+    Writer writer(output, indent_size, indent_step);
+    writer.Value(doc.GetRoot());
+}
+
+Writer::Writer(std::ostream& output, int indent_size, int indent_step)
+    : output_(output)
+    , indent_size_(indent_size)
+    , indent_step_(indent_step) {
+}
+
+Writer::~Writer() {
+    Flush();
+}
+
+Writer& Writer::StartDict() {
+    BeginValue();
+    Write("{"sv);
+    WriteLineBreak();
+    stack_.push_back({true, false});
+    return *this;
+}
+
+Writer& Writer::Key(string_view key) {
+    if (stack_.empty() || !stack_.back().is_dict || has_key_) {
+        throw logic_error("key outside of dict"s);
+    }
+
+    if (stack_.back().has_items) {
+        Write(","sv);
+        WriteLineBreak();
+    }
+    WriteIndent(stack_.size());
+
+    Write("\""sv);
+    Write(key);
+    Write(indent_size_ == COMPACT ? "\":"sv : "\": "sv);
+
+    stack_.back().has_items = true;
+    has_key_ = true;
+    return *this;
+}
+
+Writer& Writer::EndDict() {
+    return EndContainer(true, '}');
+}
+
+Writer& Writer::StartArray() {
+    BeginValue();
+    Write("["sv);
+    WriteLineBreak();
+    stack_.push_back({false, false});
+    return *this;
+}
+
+Writer& Writer::EndArray() {
+    return EndContainer(false, ']');
+}
+
+Writer& Writer::Value(nullptr_t) {
+    BeginValue();
+    Write("null"sv);
+    return *this;
+}
+
+Writer& Writer::Value(bool value) {
+    BeginValue();
+    Write(value ? "true"sv : "false"sv);
+    return *this;
+}
+
+Writer& Writer::Value(int value) {
+    BeginValue();
+    WriteNumber(value);
+    return *this;
+}
+
+Writer& Writer::Value(double value) {
+    BeginValue();
+    WriteNumber(value);
+    return *this;
+}
+
+Writer& Writer::Value(const char* value) {
+    return Value(string_view(value));
+}
+
+Writer& Writer::Value(string_view value) {
+    BeginValue();
+    Write("\""sv);
+
+    size_t run_begin = 0;
+    for (size_t i = 0; i < value.size(); ++i) {
+        string_view escaped;
+        switch (value[i]) {
+            case '\n': escaped = "\\n"sv; break;
+            case '\r': escaped = "\\r"sv; break;
+            case '"': escaped = "\\\""sv; break;
+            case '\\': escaped = "\\\\"sv; break;
+            default: continue;
+        }
+        Write(value.substr(run_begin, i - run_begin));
+        Write(escaped);
+        run_begin = i + 1;
+    }
+    Write(value.substr(run_begin));
+
+    Write("\""sv);
+    return *this;
+}
+
+Writer& Writer::Value(const string& value) {
+    return Value(string_view(value));
+}
+
+Writer& Writer::Value(const Node& node) {
+    if (node.IsNull()) {
+        Value(nullptr);
+    } else if (node.IsString()) {
+        Value(node.AsString());
+    } else if (node.IsInt()) {
+        Value(node.AsInt());
+    } else if (node.IsDouble()) {
+        Value(node.AsDouble());
+    } else if (node.IsBool()) {
+        Value(node.AsBool());
+    } else if (node.IsArray()) {
+        StartArray();
+        for (const Node& item : node.AsArray()) {
+            Value(item);
+        }
+        EndArray();
+    } else if (node.IsDict()) {
+        StartDict();
+        for (const auto& [key, item] : node.AsDict()) {
+            Key(key);
+            Value(item);
+        }
+        EndDict();
+    }
+    return *this;
+}
+
+Writer& Writer::RawValue(string_view json) {
+    BeginValue();
+    Write(json);
+    return *this;
+}
+
+void Writer::Flush() {
+    output_.write(buffer_.data(), static_cast<streamsize>(buffer_.size()));
+    buffer_.clear();
+}
+
+void Writer::BeginValue() {
+    if (stack_.empty()) {
+        return;
+    }
+
+    if (stack_.back().is_dict) {
+        if (!has_key_) {
+            throw logic_error("no key in dict"s);
+        }
+        has_key_ = false;
+        return;
+    }
+
+    if (stack_.back().has_items) {
+        Write(","sv);
+        WriteLineBreak();
+    }
+    WriteIndent(stack_.size());
+    stack_.back().has_items = true;
+}
+
+Writer& Writer::EndContainer(bool is_dict, char bracket) {
+    if (stack_.empty() || stack_.back().is_dict != is_dict || has_key_) {
+        throw logic_error(is_dict ? "no opened dict"s : "no opened array"s);
+    }
+
+    if (stack_.back().has_items) {
+        WriteLineBreak();
+    }
+    WriteIndent(stack_.size() - 1);
+    Write(string_view(&bracket, 1));
+
+    stack_.pop_back();
+    return *this;
+}
+
+void Writer::WriteLineBreak() {
+    if (indent_size_ != COMPACT) {
+        Write("\n"sv);
+    }
+}
+
+void Writer::WriteIndent(size_t depth) {
+    if (indent_size_ == COMPACT) {
+        return;
+    }
+    buffer_.append(static_cast<size_t>(indent_size_) * (indent_step_ + depth - 1), ' ');
+}
+
+// Кратчайшая запись, по которой double восстанавливается точно
+template <typename Number>
+void Writer::WriteNumber(Number value) {
+    char number[32];
+    const auto result = to_chars(begin(number), end(number), value);
+    Write(string_view(number, result.ptr - number));
+}
+
+void Writer::Write(string_view data) {
+    buffer_.append(data);
+    if (buffer_.size() >= FLUSH_SIZE) {
+        Flush();
+    }
+}
+
+}  // namespace json
@@ -1,8 +1,11 @@
 #pragma once
 
+#include <algorithm>
 #include <iostream>
-#include <map>
+#include <memory_resource>
+#include <stdexcept>
 #include <string>
+#include <string_view>
 #include <variant>
 #include <vector>
 
@@ -14,8 +17,52 @@ namespace json {
     
 class Node;
 
-using Dict = std::map<std::string, Node>;
-using Array = std::vector<Node>;
+// Словарь - отсортированный по ключу массив пар: в запросах ключей немного,
+// и двоичный поиск по непрерывной памяти быстрее обхода дерева. Искать можно
+// по string_view без создания строки. Как и у std::map, emplace не заменяет
+// значение существующего ключа, поэтому при повторе ключа во входе остаётся первое
+class Dict {
+public:
+    using value_type = std::pair<std::string, Node>;
+    using iterator = std::pmr::vector<value_type>::iterator;
+    using const_iterator = std::pmr::vector<value_type>::const_iterator;
+
+    Dict() = default;
+    explicit Dict(std::pmr::memory_resource* resource);
+
+    iterator begin();
+    iterator end();
+    const_iterator begin() const;
+    const_iterator end() const;
+
+    size_t size() const;
+    bool empty() const;
+
+    iterator find(std::string_view key);
+    const_iterator find(std::string_view key) const;
+    size_t count(std::string_view key) const;
+    const Node& at(std::string_view key) const;
+
+    std::pair<iterator, bool> emplace(std::string key, Node value);
+    Node& operator[](std::string_view key);
+
+    // Заменяет содержимое парами в порядке из входа; из пар с одинаковым ключом остаётся первая
+    template <typename It>
+    void Assign(It first, It last);
+
+    bool operator==(const Dict& rhs) const;
+    bool operator!=(const Dict& rhs) const;
+
+private:
+    iterator LowerBound(std::string_view key);
+    const_iterator LowerBound(std::string_view key) const;
+
+    std::pmr::vector<value_type> items_;
+};
+
+// Контейнеры берут память из memory_resource, переданного при создании
+// (по умолчанию - из кучи), так что документ можно разместить в одном буфере
+using Array = std::pmr::vector<Node>;
 using JsonValue = std::variant<std::nullptr_t, Array, Dict, bool, int, double, std::string>;
 
 class ParsingError : public std::runtime_error {
@@ -47,6 +94,118 @@ public:
     bool operator!=(const Node& rhs ) const;
 };
     
+inline Dict::Dict(std::pmr::memory_resource* resource)
+    : items_(resource) {
+}
+
+inline Dict::iterator Dict::begin() {
+    return items_.begin();
+}
+
+inline Dict::iterator Dict::end() {
+    return items_.end();
+}
+
+inline Dict::const_iterator Dict::begin() const {
+    return items_.begin();
+}
+
+inline Dict::const_iterator Dict::end() const {
+    return items_.end();
+}
+
+inline size_t Dict::size() const {
+    return items_.size();
+}
+
+inline bool Dict::empty() const {
+    return items_.empty();
+}
+
+inline Dict::iterator Dict::LowerBound(std::string_view key) {
+    return std::lower_bound(items_.begin(), items_.end(), key, [](const value_type& item, std::string_view key) {
+        return item.first < key;
+    });
+}
+
+inline Dict::const_iterator Dict::LowerBound(std::string_view key) const {
+    return std::lower_bound(items_.begin(), items_.end(), key, [](const value_type& item, std::string_view key) {
+        return item.first < key;
+    });
+}
+
+inline Dict::iterator Dict::find(std::string_view key) {
+    auto it = LowerBound(key);
+    return it != items_.end() && it->first == key ? it : items_.end();
+}
+
+inline Dict::const_iterator Dict::find(std::string_view key) const {
+    auto it = LowerBound(key);
+    return it != items_.end() && it->first == key ? it : items_.end();
+}
+
+inline size_t Dict::count(std::string_view key) const {
+    return find(key) != items_.end() ? 1 : 0;
+}
+
+inline const Node& Dict::at(std::string_view key) const {
+    auto it = find(key);
+    if (it == items_.end()) {
+        throw std::out_of_range("no such key in dict");
+    }
+    return it->second;
+}
+
+inline std::pair<Dict::iterator, bool> Dict::emplace(std::string key, Node value) {
+    auto it = LowerBound(key);
+    if (it != items_.end() && it->first == key) {
+        return {it, false};
+    }
+    return {items_.emplace(it, std::move(key), std::move(value)), true};
+}
+
+inline Node& Dict::operator[](std::string_view key) {
+    auto it = LowerBound(key);
+    if (it == items_.end() || it->first != key) {
+        it = items_.emplace(it, std::string(key), nullptr);
+    }
+    return it->second;
+}
+
+// Короткий словарь сортируется вставками: это устойчиво и не выделяет память.
+// Длинный - std::stable_sort, потому что вставки на нём квадратичны
+template <typename It>
+void Dict::Assign(It first, It last) {
+    constexpr size_t INSERTION_SORT_LIMIT = 16;
+
+    items_.assign(first, last);
+
+    if (items_.size() <= INSERTION_SORT_LIMIT) {
+        auto less = [](std::string_view key, const value_type& item) {
+            return key < item.first;
+        };
+        for (auto it = items_.begin(); it != items_.end(); ++it) {
+            std::rotate(std::upper_bound(items_.begin(), it, it->first, less), it, std::next(it));
+        }
+    } else {
+        std::stable_sort(items_.begin(), items_.end(), [](const value_type& lhs, const value_type& rhs) {
+            return lhs.first < rhs.first;
+        });
+    }
+
+    items_.erase(std::unique(items_.begin(), items_.end(), [](const value_type& lhs, const value_type& rhs) {
+        return lhs.first == rhs.first;
+    }), items_.end());
+}
+
+inline bool Dict::operator==(const Dict& rhs) const {
+    return items_ == rhs.items_;
+}
+
+inline bool Dict::operator!=(const Dict& rhs) const {
+    return !(*this == rhs);
+}
+
 class Document {
 public:
     explicit Document(Node root);
@@ -60,9 +219,89 @@ private:
     Node root_;
 };
 
-Document Load(std::istream& input);
+// Массивы и словари документа размещаются в resource, он должен пережить документ.
+// С std::pmr::monotonic_buffer_resource разбор почти не обращается к куче, а память
+// освобождается вся сразу вместе с буфером
+Document Load(std::istream& input,
+    std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+Document Load(std::string_view input,
+    std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+
+// Получатель событий потокового разбора. Методы повторяют json::Builder и вызываются
+// в порядке появления значений во входе, поэтому документ целиком не строится
+class Handler {
+public:
+    virtual ~Handler() = default;
+
+    virtual void StartDict() = 0;
+    virtual void Key(std::string key) = 0;
+    virtual void EndDict() = 0;
+    virtual void StartArray() = 0;
+    virtual void EndArray() = 0;
+    virtual void Value(JsonValue value) = 0;
+};
+
+void Parse(std::istream& input, Handler& handler);
+void Parse(std::string_view input, Handler& handler);
 
 void Print(const Document& doc, std::ostream& output, 
     int indent_size = 2, int indent_step = 1);
 
+// Пишет JSON в поток по мере вызовов, не строя документ, в том же формате, что и Print.
+// Ключи выводятся в порядке вызовов Key: чтобы вывод совпал с Print, их нужно передавать
+// отсортированными. Вывод копится в буфере и сбрасывается в поток порциями и в деструкторе
+class Writer {
+public:
+    // Отступ, при котором всё значение пишется в одну строку без пробелов
+    static constexpr int COMPACT = -1;
+
+    explicit Writer(std::ostream& output, int indent_size = 2, int indent_step = 1);
+    ~Writer();
+
+    Writer(const Writer&) = delete;
+    Writer& operator=(const Writer&) = delete;
+
+    Writer& StartDict();
+    Writer& Key(std::string_view key);
+    Writer& EndDict();
+    Writer& StartArray();
+    Writer& EndArray();
+
+    Writer& Value(std::nullptr_t);
+    Writer& Value(bool value);
+    Writer& Value(int value);
+    Writer& Value(double value);
+    Writer& Value(const char* value);
+    Writer& Value(std::string_view value);
+    Writer& Value(const std::string& value);
+    Writer& Value(const Node& node);
+    // Вставляет значение, уже записанное другим Writer с нужным отступом
+    Writer& RawValue(std::string_view json);
+
+    void Flush();
+
+private:
+    static constexpr size_t FLUSH_SIZE = 1 << 16;
+
+    struct Frame {
+        bool is_dict;
+        bool has_items;
+    };
+
+    void BeginValue();
+    Writer& EndContainer(bool is_dict, char bracket);
+    void WriteLineBreak();
+    void WriteIndent(size_t depth);
+    template <typename Number>
+    void WriteNumber(Number value);
+    void Write(std::string_view data);
+
+    std::ostream& output_;
+    int indent_size_;
+    int indent_step_;
+    std::string buffer_;
+    std::vector<Frame> stack_;
+    bool has_key_ = false;
+};
+
 }  // namespace json
\ No newline at end of file
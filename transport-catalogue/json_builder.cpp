@@ -3,6 +3,10 @@
 using namespace std;
 
 namespace json {
+
+Builder::Builder(std::pmr::memory_resource* resource)
+    : resource_(resource) {
+}
     
 DictItemContext Builder::StartDict() {
     if (ready_) {
@@ -17,15 +21,15 @@ DictItemContext Builder::StartDict() {
     }
    
     if (path_.size() == 0) {
-        root_ = Dict{};
+        root_ = Dict(resource_);
         path_.push_back(&root_);
     } else if (path_.back()->IsArray()) {
         Array& arr = const_cast<Array&>(path_.back()->AsArray());
-        arr.push_back(Dict{});
+        arr.push_back(Dict(resource_));
         path_.push_back(&arr.back());
     } else if (path_.back()->IsDict()) {
         Dict& dict = const_cast<Dict&>(path_.back()->AsDict());
-        dict[last_key_] = Dict{};
+        dict[last_key_] = Dict(resource_);
         path_.push_back(&dict[last_key_]);
         has_key = false;
     }
@@ -48,15 +52,15 @@ ArrayItemContext Builder::StartArray() {
     }
     
     if (path_.size() == 0) {
-        root_ = Array{};
+        root_ = Array(resource_);
         path_.push_back(&root_);
     } else if (path_.back()->IsArray()) {
         Array& arr = const_cast<Array&>(path_.back()->AsArray());
-        arr.push_back(Array{});
+        arr.push_back(Array(resource_));
         path_.push_back(&arr.back());
     } else if (path_.back()->IsDict()) {
         Dict& dict = const_cast<Dict&>(path_.back()->AsDict());
-        dict[last_key_] = Array{};
+        dict[last_key_] = Array(resource_);
         path_.push_back(&dict[last_key_]);
         has_key = false;
     }
@@ -140,7 +144,7 @@ Builder& Builder::Value(JsonValue val) {
     if (holds_alternative<nullptr_t>(val)) {
         value = move(get<nullptr_t>(val));
     } else if (holds_alternative<Array>(val)) {
-        value = get<Array>(val);
+        value = move(get<Array>(val));
     } else if (holds_alternative<Dict>(val)) {
         value = move(get<Dict>(val));
     } else if (holds_alternative<bool>(val)) {
@@ -175,6 +179,14 @@ const Node& Builder::Build() {
     
     return root_;
 }
+
+Node Builder::Extract() {
+    Build();
+
+    Node result = move(root_);
+    *this = Builder{resource_};
+    return result;
+}
     
 KeyItemContext ItemContext::Key(string key) {
     return builder_->Key(std::move(key));
@@ -13,6 +13,7 @@ class ArrayItemContext;
 class Builder {
         
 private:
+    std::pmr::memory_resource* resource_;
     Node root_;
     std::vector<Node*> path_;
     int opened_arrays_ = 0;
@@ -21,6 +22,9 @@ private:
     bool has_key = false;
     bool ready_ = false;
 public:
+    // Массивы и словари создаются в resource, он должен пережить построенный документ
+    explicit Builder(std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+
     DictItemContext StartDict();
     ArrayItemContext  StartArray();
     KeyItemContext  Key(std::string);
@@ -30,6 +34,8 @@ public:
     Builder& EndArray();
 
     const Node& Build();
+    // Как Build, но документ переносится из построителя, и тот нужно заполнять заново
+    Node Extract();
 };
     
 class ItemContext {
@@ -1,47 +1,196 @@
 #include "json_reader.h"
 
+#include "json_builder.h"
+
 using namespace std;
 
 namespace transport {
 
-JsonReader::JsonReader(std::istream& input) : json_doc_(json::Load(input)) {
+// Верхний уровень входа собирается в словарь, кроме base_requests: каждый из этих
+// запросов собирается отдельно, передаётся в каталог и сразу освобождается
+class JsonReader::BaseRequestsHandler final : public json::Handler {
+public:
+    BaseRequestsHandler(JsonReader& reader, TransportCatalogue& catalogue)
+        : reader_(reader)
+        , catalogue_(catalogue)
+        , root_(&reader.arena_) {
+    }
+
+    void StartDict() override {
+        if (depth_ > 0) {
+            BeginValue();
+            if (building_) {
+                builder_.StartDict();
+            }
+        }
+        ++depth_;
+    }
+
+    void Key(string key) override {
+        if (building_) {
+            builder_.Key(move(key));
+        } else {
+            key_ = move(key);
+        }
+    }
+
+    void EndDict() override {
+        --depth_;
+        if (building_) {
+            builder_.EndDict();
+            EndValue();
+        }
+    }
+
+    void StartArray() override {
+        CheckRoot();
+        if (depth_ == 1 && !building_ && key_ == "base_requests"s) {
+            in_requests_ = true;
+        } else {
+            BeginValue();
+            if (building_) {
+                builder_.StartArray();
+            }
+        }
+        ++depth_;
+    }
+
+    void EndArray() override {
+        --depth_;
+        if (building_) {
+            builder_.EndArray();
+            EndValue();
+        } else if (depth_ == 1) {
+            in_requests_ = false;
+        }
+    }
+
+    void Value(json::JsonValue value) override {
+        CheckRoot();
+        BeginValue();
+        builder_.Value(move(value));
+        EndValue();
+    }
+
+    json::Document ExtractDocument() {
+        return json::Document{json::Node{move(root_)}};
+    }
+
+private:
+    void CheckRoot() const {
+        if (depth_ == 0) {
+            throw json::ParsingError{"root must be a dict"s};
+        }
+    }
+
+    void BeginValue() {
+        if (!building_) {
+            builder_ = json::Builder{in_requests_ ? &request_arena_ : &reader_.arena_};
+            building_ = true;
+            value_depth_ = depth_;
+        }
+    }
+
+    void EndValue() {
+        if (depth_ != value_depth_) {
+            return;
+        }
+        building_ = false;
+
+        if (in_requests_) {
+            reader_.AddBaseRequest(builder_.Build().AsDict(), catalogue_);
+
+            // запрос больше не нужен: сначала разрушается его дерево, затем память отдаётся целиком
+            builder_ = json::Builder{};
+            request_arena_.release();
+        } else {
+            root_.emplace(move(key_), builder_.Extract());
+        }
+    }
+
+    JsonReader& reader_;
+    TransportCatalogue& catalogue_;
+
+    json::Dict root_;
+    // память под текущий запрос из base_requests
+    std::pmr::monotonic_buffer_resource request_arena_;
+    json::Builder builder_;
+    string key_;
+    size_t depth_ = 0;
+    size_t value_depth_ = 0;
+    bool building_ = false;
+    bool in_requests_ = false;
+};
+
+JsonReader::JsonReader(std::istream& input) : json_doc_(json::Load(input, &arena_)) {
+
+}
 
+JsonReader::JsonReader(std::istream& input, TransportCatalogue& catalogue) : is_streamed_(true) {
+    BaseRequestsHandler handler(*this, catalogue);
+    json::Parse(input, handler);
+    json_doc_ = handler.ExtractDocument();
 }
 
 const json::Array& JsonReader::GetBaseRequests() const {
-    return json_doc_.GetRoot().AsDict().at("base_requests"s).AsArray();
+    return json_doc_.GetRoot().AsDict().at("base_requests"sv).AsArray();
 }
 
 const json::Dict& JsonReader::GetRenderSettingsJson() const {
-    return json_doc_.GetRoot().AsDict().at("render_settings"s).AsDict();
+    return json_doc_.GetRoot().AsDict().at("render_settings"sv).AsDict();
 }
 
 bool JsonReader::HasRenderSettings() const {
-    return json_doc_.GetRoot().AsDict().count("render_settings"s) > 0;
+    return json_doc_.GetRoot().AsDict().count("render_settings"sv) > 0;
 }
 
 const json::Array& JsonReader::GetStatRequests() const {
-    return json_doc_.GetRoot().AsDict().at("stat_requests"s).AsArray();
+    return json_doc_.GetRoot().AsDict().at("stat_requests"sv).AsArray();
 }
 
 route::RouteSettings JsonReader::GetRouteSettings() const {
-    const json::Dict& settings =  json_doc_.GetRoot().AsDict().at("routing_settings"s).AsDict();
-
-    return {settings.at("bus_wait_time").AsInt(), settings.at("bus_velocity").AsInt()};
+    return DictToRouteSettings(json_doc_.GetRoot().AsDict().at("routing_settings"sv).AsDict());
 }
 
 optional<route::RouteSettings> JsonReader::GetRouteSettingsOpt() const {
-    if (json_doc_.GetRoot().AsDict().count("routing_settings"s) > 0) {
-        const json::Dict& settings =  json_doc_.GetRoot().AsDict().at("routing_settings"s).AsDict();
-
-        return route::RouteSettings{settings.at("bus_wait_time").AsInt(), settings.at("bus_velocity").AsInt()};
+    if (json_doc_.GetRoot().AsDict().count("routing_settings"sv) > 0) {
+        return GetRouteSettings();
     }
 
     return {};
 }
 
 serialize::Settings JsonReader::GetSerializeSettings() const {
-    return {json_doc_.GetRoot().AsDict().at("serialization_settings"s).AsDict().at("file").AsString()};
+    const json::Dict& settings_dict = json_doc_.GetRoot().AsDict().at("serialization_settings"sv).AsDict();
+
+    serialize::Settings settings;
+    settings.file = settings_dict.at("file"sv).AsString();
+
+    if (settings_dict.count("threads"sv) > 0) {
+        const int threads = settings_dict.at("threads"sv).AsInt();
+        if (threads < 0) {
+            throw invalid_argument("wrong threads count"s);
+        }
+        settings.threads = static_cast<size_t>(threads);
+    }
+
+    if (settings_dict.count("format"sv) > 0) {
+        const string& format = settings_dict.at("format"sv).AsString();
+
+        if (format == "protobuf"s) {
+            settings.format = serialize::Format::PROTOBUF;
+        } else if (format == "flat"s) {
+            settings.format = serialize::Format::FLAT;
+        } else {
+            throw invalid_argument("wrong serialization format"s);
+        }
+    }
+
+    if (settings_dict.count("store_map"sv) > 0) {
+        settings.store_map = settings_dict.at("store_map"sv).AsBool();
+    }
+
+    return settings;
 }
 
 svg::Color JsonReader::GetColorFromNode(const json::Node& n) const {
@@ -68,40 +217,77 @@ svg::Color JsonReader::GetColorFromNode(const json::Node& n) const {
 renderer::RenderSettings JsonReader::DictToRenderSettings(const json::Dict& settings_dict) const {
     renderer::RenderSettings settings;
     
-    settings.width = settings_dict.at("width"s).AsDouble();
-    settings.height = settings_dict.at("height"s).AsDouble();
-    settings.padding = settings_dict.at("padding"s).AsDouble();
-    settings.line_width = settings_dict.at("line_width"s).AsDouble();
-    settings.stop_radius = settings_dict.at("stop_radius"s).AsDouble();
-    settings.bus_label_font_size = settings_dict.at("bus_label_font_size"s).AsInt();
+    settings.width = settings_dict.at("width"sv).AsDouble();
+    settings.height = settings_dict.at("height"sv).AsDouble();
+    settings.padding = settings_dict.at("padding"sv).AsDouble();
+    settings.line_width = settings_dict.at("line_width"sv).AsDouble();
+    settings.stop_radius = settings_dict.at("stop_radius"sv).AsDouble();
+    settings.bus_label_font_size = settings_dict.at("bus_label_font_size"sv).AsInt();
 
-    const auto& blo = settings_dict.at("bus_label_offset"s).AsArray();
+    const auto& blo = settings_dict.at("bus_label_offset"sv).AsArray();
 
     settings.bus_label_offset = svg::Point{blo[0].AsDouble(), blo[1].AsDouble()};
-    settings.stop_label_font_size = settings_dict.at("stop_label_font_size"s).AsInt();
+    settings.stop_label_font_size = settings_dict.at("stop_label_font_size"sv).AsInt();
 
-    const auto& slo = settings_dict.at("stop_label_offset"s).AsArray();
+    const auto& slo = settings_dict.at("stop_label_offset"sv).AsArray();
 
     settings.stop_label_offset = svg::Point{slo[0].AsDouble(), slo[1].AsDouble()};
 
-    settings.underlayer_color = GetColorFromNode(settings_dict.at("underlayer_color"s));
+    settings.underlayer_color = GetColorFromNode(settings_dict.at("underlayer_color"sv));
 
-    settings.underlayer_width  = settings_dict.at("underlayer_width"s).AsDouble();
+    settings.underlayer_width  = settings_dict.at("underlayer_width"sv).AsDouble();
 
-    for (const json::Node& n: settings_dict.at("color_palette"s).AsArray()) {
+    for (const json::Node& n: settings_dict.at("color_palette"sv).AsArray()) {
         settings.color_palette.push_back(GetColorFromNode(n));
     }
 
     return settings;
 }
 
+route::RouteSettings JsonReader::DictToRouteSettings(const json::Dict& settings_dict) const {
+    route::RouteSettings settings;
+
+    settings.bus_wait_time = settings_dict.at("bus_wait_time"sv).AsInt();
+    settings.bus_velocity = settings_dict.at("bus_velocity"sv).AsInt();
+
+    if (settings_dict.count("router_mode"sv) > 0) {
+        const string& mode = settings_dict.at("router_mode"sv).AsString();
+
+        if (mode == "all_pairs"s) {
+            settings.router_mode = graph::RouterMode::ALL_PAIRS;
+        } else if (mode == "dijkstra"s) {
+            settings.router_mode = graph::RouterMode::DIJKSTRA;
+        } else if (mode == "a_star"s) {
+            settings.router_mode = graph::RouterMode::A_STAR;
+        } else if (mode == "contraction_hierarchy"s) {
+            settings.router_mode = graph::RouterMode::CONTRACTION_HIERARCHY;
+        } else {
+            throw invalid_argument("wrong router mode"s);
+        }
+    }
+
+    if (settings_dict.count("graph_model"sv) > 0) {
+        const string& model = settings_dict.at("graph_model"sv).AsString();
+
+        if (model == "stop_pairs"s) {
+            settings.graph_model = route::GraphModel::STOP_PAIRS;
+        } else if (model == "stop_events"s) {
+            settings.graph_model = route::GraphModel::STOP_EVENTS;
+        } else {
+            throw invalid_argument("wrong graph model"s);
+        }
+    }
+
+    return settings;
+}
+
 parsed::Bus JsonReader::DictToBus(const json::Dict& bus_dict) const {
     parsed::Bus bus;
 
-    bus.name = move(const_cast<string&>(bus_dict.at("name"s).AsString()));
-    bus.circular = bus_dict.at("is_roundtrip"s).AsBool();
+    bus.name = move(const_cast<string&>(bus_dict.at("name"sv).AsString()));
+    bus.circular = bus_dict.at("is_roundtrip"sv).AsBool();
 
-    for (const auto& str_node: bus_dict.at("stops"s).AsArray()) {
+    for (const auto& str_node: bus_dict.at("stops"sv).AsArray()) {
         bus.stops.push_back(move(const_cast<string&>(str_node.AsString())));
     }
 
@@ -112,13 +298,13 @@ std::pair<parsed::Stop, parsed::Distances> JsonReader::DictToStopDists(const jso
     parsed::Stop p_s;
     parsed::Distances p_d;
 
-    p_s.name = stop_dict.at("name"s).AsString();
-    p_d.from = move(const_cast<string&>(stop_dict.at("name"s).AsString()));
+    p_s.name = stop_dict.at("name"sv).AsString();
+    p_d.from = move(const_cast<string&>(stop_dict.at("name"sv).AsString()));
 
-    p_s.lat = stop_dict.at("latitude"s).AsDouble();
-    p_s.lng = stop_dict.at("longitude"s).AsDouble();
+    p_s.lat = stop_dict.at("latitude"sv).AsDouble();
+    p_s.lng = stop_dict.at("longitude"sv).AsDouble();
 
-    for (const auto& [to, dist]: stop_dict.at("road_distances"s).AsDict()) {
+    for (const auto& [to, dist]: stop_dict.at("road_distances"sv).AsDict()) {
         p_d.d_map.emplace(move(const_cast<string&>(to)), dist.AsInt());
     }
 
@@ -136,39 +322,39 @@ optional<renderer::RenderSettings> JsonReader::GetRenderSettings() const {
 
 // Оставил наполенние каталога в JsonReader потому что иначе пришлось бы переносить всю логику разбора json запросов
 // в RequestHandler, а он этим по идее не должен заниматься
-void JsonReader::FillCatalogue(TransportCatalogue& catalogue) const {
-    vector<parsed::Bus> add_bus_deferred;
-    vector<parsed::Distances> add_dists_deferred;
+void JsonReader::FillCatalogue(TransportCatalogue& catalogue, size_t threads_count) {
+    if (!is_streamed_) {
+        for (const auto& item : GetBaseRequests()) {
+            AddBaseRequest(item.AsDict(), catalogue);
+        }
+    }
 
-    const json::Array& requests = GetBaseRequests();
+    for (const auto& d : distances_deferred_) {
+        catalogue.AddDistances(d);
+    }
 
-    for (const auto& item : requests) {
+    catalogue.AddBuses(buses_deferred_, threads_count);
+    catalogue.Freeze();
 
-        const auto& dict = item.AsDict();
-        
-        const string& type = dict.at("type"s).AsString();
+    distances_deferred_.clear();
+    buses_deferred_.clear();
+}
 
-        if (type == "Stop"s) {
-            auto [parsed_stop, parsed_distances] = DictToStopDists(dict);
+void JsonReader::AddBaseRequest(const json::Dict& request, TransportCatalogue& catalogue) {
+    const string& type = request.at("type"sv).AsString();
 
-            if (parsed_distances.d_map.size() > 0) {
-                add_dists_deferred.push_back(move(parsed_distances));
-            }
+    if (type == "Stop"sv) {
+        auto [parsed_stop, parsed_distances] = DictToStopDists(request);
 
-            catalogue.AddStop(parsed_stop);
-        } else if (type == "Bus"s) {
-            add_bus_deferred.push_back(DictToBus(dict));
-        } else {
-            throw invalid_argument("wrong query to catalogue"s);
+        if (parsed_distances.d_map.size() > 0) {
+            distances_deferred_.push_back(move(parsed_distances));
         }
-    }
-
-    for (const auto& d : add_dists_deferred) {
-        catalogue.AddDistances(d);
-    }
 
-    for (const auto& bus : add_bus_deferred) {
-        catalogue.AddBus(bus);
+        catalogue.AddStop(parsed_stop);
+    } else if (type == "Bus"sv) {
+        buses_deferred_.push_back(DictToBus(request));
+    } else {
+        throw invalid_argument("wrong query to catalogue"s);
     }
 }
 
@@ -176,10 +362,11 @@ void JsonReader::FillCatalogue(TransportCatalogue& catalogue) const {
 // перенёс логику формирования json массива в RequestHandler, так как если бы он  выдавал не json, а свои структуры,
 // то пришлось бы ещё раз проверять тип возвращённого значения, для формирования нужного элемента json массива
 // в этой функции, а это вызвыло бы дублирование кода
-void JsonReader::PrintJsonResponse(const RequestHandler& handler, std::ostream& out) const {
+void JsonReader::PrintJsonResponse(const RequestHandler& handler, std::ostream& out,
+    size_t threads_count) const {
     const json::Array& requests = GetStatRequests();
 
-    json::Print(handler.GetJsonResponse(requests), out);
+    handler.WriteJsonResponse(requests, out, threads_count);
 }
 
 } // transport
\ No newline at end of file
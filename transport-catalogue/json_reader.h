@@ -1,6 +1,8 @@
 #pragma once
 
 #include <iostream>
+#include <memory_resource>
+#include <vector>
 
 #include "map_renderer.h"
 #include "transport_catalogue.h"
@@ -13,8 +15,17 @@ namespace transport {
 
 class JsonReader {
 private:
+    class BaseRequestsHandler;
+
+    // массивы и словари документа; объявлен раньше json_doc_, чтобы пережить его
+    std::pmr::monotonic_buffer_resource arena_;
     json::Document json_doc_{json::Node{nullptr}};
 
+    // запросы, которые можно выполнить только после добавления всех остановок
+    std::vector<parsed::Distances> distances_deferred_;
+    std::vector<parsed::Bus> buses_deferred_;
+    bool is_streamed_ = false;
+
     const json::Array& GetBaseRequests() const;
 
     const json::Dict& GetRenderSettingsJson() const;
@@ -25,13 +36,21 @@ private:
 
     renderer::RenderSettings DictToRenderSettings(const json::Dict& settings_dict) const;
 
+    route::RouteSettings DictToRouteSettings(const json::Dict& settings_dict) const;
+
     parsed::Bus DictToBus(const json::Dict& bus_dict) const;
 
     std::pair<parsed::Stop, parsed::Distances> DictToStopDists(const json::Dict& stop_dict) const;
 
+    void AddBaseRequest(const json::Dict& request, TransportCatalogue& catalogue);
+
 public:
     JsonReader(std::istream& input);
 
+    // Разбирает вход потоково: base_requests не сохраняются в документе, остановки
+    // сразу добавляются в catalogue, остальное добавит FillCatalogue с тем же каталогом
+    JsonReader(std::istream& input, TransportCatalogue& catalogue);
+
     route::RouteSettings GetRouteSettings() const;
 
     serialize::Settings GetSerializeSettings() const;
@@ -42,9 +61,9 @@ public:
 
     bool HasRenderSettings() const; 
 
-    void FillCatalogue(TransportCatalogue& catalogue) const;
+    void FillCatalogue(TransportCatalogue& catalogue, size_t threads_count = 1);
 
-    void PrintJsonResponse(const RequestHandler& handler, std::ostream& out) const;
+    void PrintJsonResponse(const RequestHandler& handler, std::ostream& out, size_t threads_count = 1) const;
 };
 
 } // transport
\ No newline at end of file
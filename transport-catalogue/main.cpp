@@ -1,16 +1,30 @@
+#include <charconv>
 #include <iostream>
 #include <memory>
 #include <fstream>
+#include <optional>
 #include <string_view>
 
 #include "json_reader.h"
+#include "request_server.h"
 #include "transport_router.h"
 
 using namespace std::literals;
 using namespace std;
 
 void PrintUsage(std::ostream& stream = std::cerr) {
-    stream << "Usage: transport_catalogue [make_base|process_requests]\n"sv;
+    stream << "Usage: transport_catalogue [make_base [threads]|process_requests [threads]|serve base_file [socket]]\n"sv;
+}
+
+// Число потоков из аргумента командной строки, nullopt - если это не число
+std::optional<size_t> ParseThreadsCount(std::string_view arg) {
+    size_t threads_count;
+    auto [ptr, ec] = std::from_chars(arg.data(), arg.data() + arg.size(), threads_count);
+
+    if (ec != std::errc() || ptr != arg.data() + arg.size()) {
+        return std::nullopt;
+    }
+    return threads_count;
 }
 
 // int prev_main() {
@@ -35,7 +49,7 @@ int main(int argc, char* argv[]) {
     using namespace transport;
     using namespace route;
 
-    if (argc != 2) {
+    if (argc < 2 || argc > 4) {
         PrintUsage();
         return 1;
     }
@@ -44,25 +58,63 @@ int main(int argc, char* argv[]) {
 
     const std::string_view mode(argv[1]);
 
-    if (mode == "make_base"sv) {
-        JsonReader reader(cin);
-        reader.FillCatalogue(catalogue);
+    // число потоков проверяется до чтения входа
+    std::optional<size_t> threads_count;
+    if (mode != "serve"sv && argc == 3 && !(threads_count = ParseThreadsCount(argv[2]))) {
+        PrintUsage();
+        return 1;
+    }
+
+    if (mode == "make_base"sv && argc <= 3) {
+        JsonReader reader(cin, catalogue);
+        serialize::Settings settings = reader.GetSerializeSettings();
+
+        if (threads_count) {
+            settings.threads = *threads_count;
+        }
+
+        reader.FillCatalogue(catalogue, settings.threads);
         RequestHandler handler(catalogue);
 
-        handler.Serialize(reader.GetSerializeSettings(), reader.GetRenderSettings(), reader.GetRouteSettingsOpt());
+        handler.Serialize(settings, reader.GetRenderSettings(), reader.GetRouteSettingsOpt());
 
-    } else if (mode == "process_requests"sv) {
+    } else if (mode == "process_requests"sv && argc <= 3) {
         JsonReader reader(cin);
+        serialize::Settings settings = reader.GetSerializeSettings();
+
+        if (threads_count) {
+            settings.threads = *threads_count;
+        }
+
         RequestHandler handler(catalogue);
 
-        handler.Deserialize(reader.GetSerializeSettings());
+        handler.Deserialize(settings);
 
-        reader.PrintJsonResponse(handler, cout);
+        reader.PrintJsonResponse(handler, cout, settings.threads);
 
         // ofstream svg("out.svg");
 
         // handler.RenderMap().Render(svg);
 
+    } else if (mode == "serve"sv && argc >= 3) {
+        serialize::Settings settings;
+        settings.file = argv[2];
+
+        RequestHandler handler(catalogue);
+
+        // сервер с пустым каталогом отвечал бы "not found" на всё, поэтому без базы он не запускается
+        if (!handler.Deserialize(settings)) {
+            return 1;
+        }
+
+        RequestServer server(handler, 0);
+
+        if (argc == 4) {
+            server.ServeSocket(argv[3]);
+        } else {
+            server.ServeStream(cin, cout);
+        }
+
     } else {
         PrintUsage();
         return 1;
@@ -56,7 +56,7 @@ void BusLabel::Draw(svg::ObjectContainer& container) const {
         .SetFontSize(settings_.bus_label_font_size)
         .SetFontFamily("Verdana"s)
         .SetFontWeight("bold"s)
-        .SetData(bus_->name);
+        .SetData(string(bus_->name));
     
     svg::Text under = base;
     svg::Text actual = move(base);
@@ -127,10 +127,10 @@ void StopLabels::Draw(svg::ObjectContainer& container) const {
          
     for (const auto stop : stops_) {
         under.SetPosition(proj_(stop->coordinates))
-             .SetData(stop->name);
+             .SetData(string(stop->name));
 
         actual.SetPosition(proj_(stop->coordinates))
-              .SetData(stop->name);
+              .SetData(string(stop->name));
 
         container.Add(under);
         container.Add(actual);
@@ -0,0 +1,76 @@
+#include "mapped_file.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define TC_HAS_MMAP
+#else
+#include <fstream>
+#endif
+
+namespace serialize {
+
+MappedFile::MappedFile(const std::filesystem::path& path) {
+#ifdef TC_HAS_MMAP
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return;
+    }
+
+    struct stat file_stat;
+    if (::fstat(fd, &file_stat) == 0) {
+        size_ = static_cast<size_t>(file_stat.st_size);
+
+        if (size_ == 0) {
+            is_open_ = true;
+        } else {
+            void* data = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (data != MAP_FAILED) {
+                data_ = static_cast<const char*>(data);
+                is_mapped_ = true;
+                is_open_ = true;
+            }
+        }
+    }
+
+    ::close(fd);
+#else
+    std::ifstream in_file(path, std::ios::binary | std::ios::ate);
+    if (!in_file.is_open()) {
+        return;
+    }
+
+    buffer_.resize(static_cast<size_t>(in_file.tellg()));
+    in_file.seekg(0);
+
+    if (in_file.read(buffer_.data(), static_cast<std::streamsize>(buffer_.size()))) {
+        data_ = buffer_.data();
+        size_ = buffer_.size();
+        is_open_ = true;
+    }
+#endif
+}
+
+MappedFile::~MappedFile() {
+#ifdef TC_HAS_MMAP
+    if (is_mapped_) {
+        ::munmap(const_cast<char*>(data_), size_);
+    }
+#endif
+}
+
+bool MappedFile::IsOpen() const {
+    return is_open_;
+}
+
+const char* MappedFile::GetData() const {
+    return data_;
+}
+
+size_t MappedFile::GetSize() const {
+    return size_;
+}
+
+} // serialize
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <vector>
+
+namespace serialize {
+
+// Файл, отображённый в память только для чтения. Там, где mmap недоступен,
+// содержимое файла читается в буфер целиком
+class MappedFile {
+public:
+    explicit MappedFile(const std::filesystem::path& path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool IsOpen() const;
+    const char* GetData() const;
+    size_t GetSize() const;
+
+private:
+    bool is_open_ = false;
+    bool is_mapped_ = false;
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+    std::vector<char> buffer_;
+};
+
+} // serialize
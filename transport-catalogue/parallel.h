@@ -0,0 +1,116 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdlib>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace parallel {
+
+// Число потоков для работы: 0 означает "по числу ядер". Больше потоков, чем ядер,
+// не запускается, сколько бы ни попросили в настройках или в командной строке
+inline size_t ResolveThreadsCount(size_t threads_count) {
+    const size_t cores_count = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+    if (threads_count == 0) {
+        return cores_count;
+    }
+    return std::min(threads_count, cores_count);
+}
+
+// Число частей, на которые ForEachChunk разобьёт диапазон из count элементов
+inline size_t ChunksCount(size_t count, size_t threads_count) {
+    return std::min(ResolveThreadsCount(threads_count), std::max<size_t>(count, 1));
+}
+
+// Делит диапазон [0, count) на не более чем threads_count непрерывных частей
+// и вызывает func(begin, end, part_index) для каждой части в отдельном потоке.
+// Части нумеруются по порядку, поэтому результаты можно собрать детерминированно.
+// Исключение из любого потока пробрасывается в вызывающий поток
+template <typename Func>
+void ForEachChunk(size_t count, size_t threads_count, Func func) {
+    const size_t parts = ChunksCount(count, threads_count);
+
+    if (parts == 1) {
+        func(size_t{0}, count, size_t{0});
+        return;
+    }
+
+    std::vector<std::exception_ptr> errors(parts);
+    std::vector<std::thread> threads;
+    threads.reserve(parts - 1);
+
+    auto run_part = [&](size_t part) {
+        const size_t begin = count * part / parts;
+        const size_t end = count * (part + 1) / parts;
+        try {
+            func(begin, end, part);
+        } catch (...) {
+            errors[part] = std::current_exception();
+        }
+    };
+
+    for (size_t part = 1; part < parts; ++part) {
+        threads.emplace_back(run_part, part);
+    }
+    run_part(0);
+
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    for (const auto& error : errors) {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+}
+
+// Вызывает func(index) для каждого index из [0, count) в threads_count потоках.
+// Потоки берут индексы из общего счётчика, поэтому задачи разной стоимости
+// распределяются равномерно. Исключение пробрасывается, как в ForEachChunk
+template <typename Func>
+void ForEachIndex(size_t count, size_t threads_count, Func func) {
+    std::atomic<size_t> next_index{0};
+
+    ForEachChunk(ChunksCount(count, threads_count), threads_count, [&](size_t, size_t, size_t) {
+        for (size_t index = next_index++; index < count; index = next_index++) {
+            func(index);
+        }
+    });
+}
+
+// Барьер для фиксированного числа потоков: Wait возвращается, когда его вызвали все.
+// Барьер многоразовый, поколения отличаются счётчиком generation_
+class Barrier {
+public:
+    explicit Barrier(size_t threads_count)
+        : threads_count_(threads_count) {
+    }
+
+    void Wait() {
+        std::unique_lock lock(mutex_);
+        const size_t generation = generation_;
+
+        if (++waiting_ == threads_count_) {
+            waiting_ = 0;
+            ++generation_;
+            cv_.notify_all();
+            return;
+        }
+
+        cv_.wait(lock, [this, generation] { return generation_ != generation; });
+    }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    const size_t threads_count_;
+    size_t waiting_ = 0;
+    size_t generation_ = 0;
+};
+
+} // parallel
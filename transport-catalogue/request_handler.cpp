@@ -1,5 +1,6 @@
 #include <sstream>
 
+#include "parallel.h"
 #include "request_handler.h"
 
 /*
@@ -14,10 +15,24 @@ using namespace std;
 
 namespace transport {
 
- RequestHandler::RequestHandler(const TransportCatalogue& db) : db_(db){
+RequestHandler::RequestHandler(const TransportCatalogue& db) {
+    auto snapshot = make_shared<Snapshot>();
+    // каталогом владеет вызывающий код
+    snapshot->db = shared_ptr<const TransportCatalogue>(shared_ptr<void>(), &db);
+    Publish(move(snapshot));
 }
 
-void RequestHandler::SetRenderer(renderer::RenderSettings settings) {
+shared_ptr<const RequestHandler::Snapshot> RequestHandler::GetSnapshot() const {
+    return atomic_load(&snapshot_);
+}
+
+void RequestHandler::Publish(shared_ptr<Snapshot> snapshot) {
+    atomic_store(&snapshot_, shared_ptr<const Snapshot>(move(snapshot)));
+}
+
+unique_ptr<renderer::MapRenderer> RequestHandler::MakeRenderer(const TransportCatalogue& db,
+    renderer::RenderSettings settings) {
+
     vector<geo::Coordinates> all_coords;
 
     vector<const Bus*> buses;
@@ -28,11 +43,11 @@ void RequestHandler::SetRenderer(renderer::RenderSettings settings) {
 
     set<const Stop*, decltype(comp)> stops(comp);
 
-    for (auto el : *db_.GetBusNames()) {
+    for (auto el : *db.GetBusNames()) {
                 
-        buses.push_back(db_.GetBus(el));
+        buses.push_back(db.GetBus(el));
         
-        const auto& bus_stops = db_.GetBus(el)->bus_stops;
+        const auto& bus_stops = db.GetBus(el)->bus_stops;
 
         for (const auto stop : bus_stops) {
             all_coords.push_back(stop->coordinates);
@@ -50,177 +65,288 @@ void RequestHandler::SetRenderer(renderer::RenderSettings settings) {
     vector<const Stop*> stops_vec(make_move_iterator(stops.begin()), 
         make_move_iterator(stops.end()));
 
-    renderer_ = make_unique<renderer::MapRenderer>(move(proj), move(settings), move(buses), move(stops_vec));
+    return make_unique<renderer::MapRenderer>(move(proj), move(settings), move(buses), move(stops_vec));
+}
+
+// Новая версия получает тот же каталог и настройки маршрутов, маршрутизатор строится заново
+void RequestHandler::SetRenderer(renderer::RenderSettings settings) {
+    const auto current = GetSnapshot();
+
+    auto snapshot = make_shared<Snapshot>();
+    snapshot->db = current->db;
+    snapshot->routing_settings = current->routing_settings;
+    snapshot->map->renderer = MakeRenderer(*snapshot->db, move(settings));
+
+    Publish(move(snapshot));
 }
 
 optional<BusStat> RequestHandler::GetBusStat(const string& bus_name) const {
-    return db_.GetBusStat(bus_name);
+    return GetSnapshot()->db->GetBusStat(bus_name);
 }
 
-const set<string_view>* RequestHandler::GetBusesThroughStop(const string& stop_name) const {
-    return db_.GetBusesThroughStop(stop_name);
+string RequestHandler::RenderSvg(renderer::MapRenderer& renderer) {
+    renderer.AddLinesToSvg();
+    renderer.AddBusLabelsToSvg();
+    renderer.AddStopSymToSvg();
+    renderer.AddStopLabelsToSvg();
+
+    ostringstream svg;
+    renderer.GetSvgDoc().Render(svg);
+    return svg.str();
 }
 
-const svg::Document& RequestHandler::RenderMap() const {
-    renderer_->AddLinesToSvg();
-    renderer_->AddBusLabelsToSvg();
-    renderer_->AddStopSymToSvg();
-    renderer_->AddStopLabelsToSvg();
+// Карта строится при первом запросе, если её не сохранили в базе при make_base.
+// Вместе с ней запоминается готовая строка JSON, так что ответ на Map - копирование байтов
+const RequestHandler::RenderedMap& RequestHandler::GetMap(const Snapshot& snapshot) {
+    RenderedMap& map = *snapshot.map;
+
+    call_once(map.once, [&map] {
+        if (map.svg.empty() && map.renderer) {
+            map.svg = RenderSvg(*map.renderer);
+        }
+
+        ostringstream json;
+        {
+            json::Writer writer(json, json::Writer::COMPACT);
+            writer.Value(map.svg);
+        }
+        map.json = json.str();
+    });
 
-    return renderer_->GetSvgDoc();
+    return map;
 }
 
-bool RequestHandler::ResetRouter() const {
-    if (routing_settings_) {
-        router_ = std::make_unique<route::TransportRouter>(db_, routing_settings_.value());
-        return true;
-    } else {
+bool RequestHandler::ResetRouter() {
+    const auto current = GetSnapshot();
+
+    if (!current->routing_settings) {
         std::cerr << "Can't find routing settings"s << std::endl;
         return false;
     }
+
+    auto snapshot = make_shared<Snapshot>();
+    snapshot->db = current->db;
+    snapshot->routing_settings = current->routing_settings;
+    snapshot->map = current->map;
+    snapshot->router = std::make_unique<route::TransportRouter>(*snapshot->db, snapshot->routing_settings.value());
+
+    Publish(move(snapshot));
+    return true;
 }
 
 bool RequestHandler::SetRouter() const {
-    if (!router_) {
-        return ResetRouter();
+    return SetRouter(*GetSnapshot());
+}
+
+// Маршрутизатор создаётся и строится один раз, при первом запросе маршрута.
+// Дальше запросы только читают его и не берут блокировок
+bool RequestHandler::SetRouter(const Snapshot& snapshot) {
+    call_once(snapshot.router_once, [&snapshot] {
+        if (!snapshot.router) {
+            if (!snapshot.routing_settings) {
+                std::cerr << "Can't find routing settings"s << std::endl;
+                return;
+            }
+            snapshot.router = std::make_unique<route::TransportRouter>(*snapshot.db, snapshot.routing_settings.value());
+        }
+
+        snapshot.router->InitRouter();
+    });
+
+    return snapshot.router != nullptr;
+}
+
+// Ответы пишутся сразу по мере вычисления. Ключи каждого ответа перечислены
+// в алфавитном порядке, как их вывел бы json::Print для словаря.
+// Все запросы сначала разбираются, затем выполняются по одной версии базы.
+// В несколько потоков запросы обрабатываются окнами: ответы окна готовятся в отдельных
+// буферах и выводятся в исходном порядке
+void RequestHandler::WriteJsonResponse(const json::Array& requests, std::ostream& out,
+    size_t threads_count) const {
+
+    const auto snapshot = GetSnapshot();
+
+    vector<StatRequest> stat_requests(requests.size());
+
+    parallel::ForEachChunk(requests.size(), threads_count, [&](size_t begin, size_t end, size_t) {
+        for (size_t i = begin; i < end; ++i) {
+            stat_requests[i] = DecodeRequest(requests[i].AsDict(), *snapshot->db);
+        }
+    });
+
+    json::Writer writer(out);
+
+    writer.StartArray();
+
+    if (parallel::ResolveThreadsCount(threads_count) == 1) {
+        for (const auto& request : stat_requests) {
+            WriteResponse(request, *snapshot, writer);
+        }
+    } else {
+        vector<string> answers(min(stat_requests.size(), RESPONSE_WINDOW));
+
+        for (size_t window_begin = 0; window_begin < stat_requests.size(); window_begin += RESPONSE_WINDOW) {
+            const size_t window_size = min(stat_requests.size() - window_begin, RESPONSE_WINDOW);
+
+            parallel::ForEachIndex(window_size, threads_count, [&](size_t index) {
+                ostringstream answer;
+                {
+                    json::Writer answer_writer(answer, 2, 2);
+                    WriteResponse(stat_requests[window_begin + index], *snapshot, answer_writer);
+                }
+                answers[index] = answer.str();
+            });
+
+            for (size_t index = 0; index < window_size; ++index) {
+                writer.RawValue(answers[index]);
+            }
+        }
     }
-    return true;
+
+    writer.EndArray();
 }
 
-std::optional<RequestHandler::Route>
-RequestHandler::BuildRoute(const std::string &from, const std::string &to) const {
-    if (!SetRouter()) {
-        return std::nullopt;
+// Весь ответ строится по одной версии базы, даже если её подменят во время записи
+void RequestHandler::WriteResponse(const json::Dict& request, json::Writer& writer) const {
+    const auto snapshot = GetSnapshot();
+
+    WriteResponse(DecodeRequest(request, *snapshot->db), *snapshot, writer);
+}
+
+RequestHandler::StatRequest RequestHandler::DecodeRequest(const json::Dict& request,
+    const TransportCatalogue& db) {
+
+    StatRequest result{StatRequest::Type::NOT_FOUND, request.at("id"sv).AsInt()};
+    const string& type = request.at("type"sv).AsString();
+
+    auto find_stop = [&db](const string& name) -> const Stop* {
+        const auto& stops = db.GetStops();
+        auto it = stops.find(name);
+        return it != stops.end() ? it->second : nullptr;
+    };
+
+    if (type == "Bus"sv) {
+        const auto& buses = db.GetBuses();
+        if (auto it = buses.find(request.at("name"sv).AsString()); it != buses.end()) {
+            result.type = StatRequest::Type::BUS;
+            result.from = it->second->id;
+        }
+    } else if (type == "Stop"sv) {
+        if (const Stop* stop = find_stop(request.at("name"sv).AsString())) {
+            result.type = StatRequest::Type::STOP;
+            result.from = stop->id;
+        }
+    } else if (type == "Map"sv) {
+        result.type = StatRequest::Type::MAP;
+    } else if (type == "Route"sv) {
+        const Stop* from = find_stop(request.at("from"sv).AsString());
+        const Stop* to = find_stop(request.at("to"sv).AsString());
+        if (from && to) {
+            result.type = StatRequest::Type::ROUTE;
+            result.from = from->id;
+            result.to = to->id;
+        }
     } else {
-        return router_->BuildRoute(from, to);
+        throw invalid_argument("wrong query to catalogue"s);
     }
+
+    return result;
 }
 
-json::Document RequestHandler::GetJsonResponse(const json::Array& requests) const {
-    auto response_builder = json::Builder{};
-    
-    auto arr_ctx = response_builder.StartArray();
-    
-    for (const auto& item : requests) {
+void RequestHandler::WriteResponse(const StatRequest& request, const Snapshot& snapshot,
+    json::Writer& writer) {
 
-        const auto& dict = item.AsDict();
+    const TransportCatalogue& db = *snapshot.db;
+    const int id = request.id;
 
-        int id = dict.at("id"s).AsInt();
-        const string& type = dict.at("type"s).AsString();
+    auto write_not_found = [&writer, id] {
+        writer.StartDict()
+            .Key("error_message"sv).Value("not found"sv)
+            .Key("request_id"sv).Value(id)
+            .EndDict();
+    };
 
-        if (type == "Bus"s) {
-            const string& name = dict.at("name"s).AsString();
-            const auto bus_stat_opt = GetBusStat(name);
+    switch (request.type) {
+    case StatRequest::Type::BUS: {
+        const auto& bus_stat = db.GetBusStatById(request.from);
+
+        writer.StartDict()
+            .Key("curvature"sv).Value(bus_stat.curvature)
+            .Key("request_id"sv).Value(id)
+            .Key("route_length"sv).Value(static_cast<int>(bus_stat.length))
+            .Key("stop_count"sv).Value(bus_stat.all_stops)
+            .Key("unique_stop_count"sv).Value(bus_stat.unique_stops)
+            .EndDict();
+        break;
+    }
+    case StatRequest::Type::STOP: {
+        writer.StartDict()
+            .Key("buses"sv)
+            .StartArray();
 
-            if (!bus_stat_opt) {     
-                arr_ctx.StartDict()
-                    .Key("request_id"s)
-                    .Value(id)
-                    .Key("error_message"s)
-                    .Value("not found"s)
-                    .EndDict();
-                continue;
-            }
+        for (string_view bus: db.GetStopById(request.from)->buses_through) {
+            writer.Value(bus);
+        }
 
-            const auto& bus_stat = bus_stat_opt.value();
-
-            arr_ctx.StartDict()
-                .Key("request_id"s)
-                .Value(id)
-                .Key("curvature"s)
-                .Value(bus_stat.curvature)
-                .Key("stop_count"s)
-                .Value(bus_stat.all_stops)
-                .Key("unique_stop_count"s)
-                .Value(bus_stat.unique_stops)
-                .Key("route_length"s)
-                .Value(static_cast<int>(bus_stat.length))
-                .EndDict();
-        } else if (type == "Stop"s) {
-            const string& name = dict.at("name"s).AsString();
-            auto stop_buses = GetBusesThroughStop(name);
-
-            if (!stop_buses) {
-                arr_ctx.StartDict()
-                    .Key("request_id"s)
-                    .Value(id)
-                    .Key("error_message"s)
-                    .Value("not found"s)
-                    .EndDict();
-                continue;
-            }
-            
-            arr_ctx.StartDict()
-                .Key("request_id"s)
-                .Value(id)
-                .Key("buses"s)
-                .StartArray();
-
-            for (string_view bus: *stop_buses) {
-                arr_ctx.Value(string(bus));
-            }
-            
-            arr_ctx.EndArray().EndDict();        
-        } else if (type == "Map"s) {
-            stringstream map_string;
-
-            const auto& svg_doc = RenderMap();
-            svg_doc.Render(map_string);
-                 
-            arr_ctx.StartDict()
-                .Key("request_id"s)
-                .Value(id)
-                .Key("map"s)
-                .Value(map_string.str())
-                .EndDict();
-        } else if (type == "Route"s) {
-            auto route_data = BuildRoute(dict.at("from"s).AsString(), dict.at("to"s).AsString());
-
-            if (!route_data) {
-                arr_ctx.StartDict()
-                    .Key("request_id"s)
-                    .Value(id)
-                    .Key("error_message"s)
-                    .Value("not found"s)
-                    .EndDict();
-                continue;
-            }
+        writer.EndArray()
+            .Key("request_id"sv).Value(id)
+            .EndDict();
+        break;
+    }
+    case StatRequest::Type::MAP:
+        writer.StartDict()
+            .Key("map"sv).RawValue(GetMap(snapshot).json)
+            .Key("request_id"sv).Value(id)
+            .EndDict();
+        break;
+    case StatRequest::Type::ROUTE: {
+        if (!SetRouter(snapshot)) {
+            write_not_found();
+            break;
+        }
 
-            double total_time = 0;
-            int wait_time = router_->GetSettings().bus_wait_time;
-            json::Array items;
+        auto& router = *snapshot.router;
+        auto route_data = router.BuildRoute(request.from, request.to);
 
-            for (const auto &edge : route_data.value()) {
-                total_time += edge.total_time;
+        if (!route_data) {
+            write_not_found();
+            break;
+        }
 
-                json::Node wait_elem = json::Builder{}.StartDict().
-                    Key("type"s).Value("Wait"s).
-                    Key("stop_name"s).Value(std::string(edge.stop_from)).
-                    Key("time"s).Value(wait_time).
-                    EndDict().Build();
-                
-                json::Node ride_elem = json::Builder{}.StartDict().
-                    Key("type"s).Value("Bus"s).
-                    Key("bus"s).Value(std::string(edge.bus_name)).
-                    Key("span_count"s).Value(edge.span_count).
-                    Key("time"s).Value(edge.total_time - wait_time).
-                    EndDict().Build();
-                
-                items.push_back(wait_elem);
-                items.push_back(ride_elem);
-            }
-            
-            arr_ctx.StartDict()
-                .Key("request_id"s).Value(id)
-                .Key("total_time"s).Value(total_time)
-                .Key("items"s).Value(items)
+        double total_time = 0;
+        int wait_time = router.GetSettings().bus_wait_time;
+
+        writer.StartDict()
+            .Key("items"sv)
+            .StartArray();
+
+        for (const auto &edge : route_data.value()) {
+            total_time += edge.total_time;
+
+            writer.StartDict()
+                .Key("stop_name"sv).Value(edge.stop_from)
+                .Key("time"sv).Value(wait_time)
+                .Key("type"sv).Value("Wait"sv)
+                .EndDict();
+
+            writer.StartDict()
+                .Key("bus"sv).Value(edge.bus_name)
+                .Key("span_count"sv).Value(edge.span_count)
+                .Key("time"sv).Value(edge.total_time - wait_time)
+                .Key("type"sv).Value("Bus"sv)
                 .EndDict();
-        } else {
-            throw invalid_argument("wrong query to catalogue"s);
         }
-    }
 
-    return json::Document(arr_ctx.EndArray().Build());
+        writer.EndArray()
+            .Key("request_id"sv).Value(id)
+            .Key("total_time"sv).Value(total_time)
+            .EndDict();
+        break;
+    }
+    case StatRequest::Type::NOT_FOUND:
+        write_not_found();
+        break;
+    }
 }
 
 void RequestHandler::Serialize(serialize::Settings settings, 
@@ -228,36 +354,89 @@ void RequestHandler::Serialize(serialize::Settings settings,
     optional<route::RouteSettings> route_settings) {
     
     serialize::Serializator serializator(settings);
+    const auto snapshot = GetSnapshot();
 
-    serializator.SaveTransportCatalogue(db_);
+    serializator.SaveTransportCatalogue(*snapshot->db);
 
     if (render_settings) {
+        if (settings.store_map) {
+            auto renderer = MakeRenderer(*snapshot->db, render_settings.value());
+            serializator.SaveMap(RenderSvg(*renderer));
+        }
        serializator.SaveRenderSettings(move(render_settings.value())); 
     }
 
     if (route_settings) {
-        router_ = std::make_unique<route::TransportRouter>(db_, route_settings.value());
-        router_->InitRouter();
-        serializator.SaveTransportRouter(*router_.get());
+        route::TransportRouter router(*snapshot->db, route_settings.value());
+        router.InitRouter(settings.threads);
+        serializator.SaveTransportRouter(router);
     }
 
-    serializator.Serialize();
+    if (!serializator.Serialize()) {
+        cerr << "Can't write the base: "s << settings.file.string() << endl;
+    }
 }
 
-void RequestHandler::Deserialize(serialize::Settings settings) {
+shared_ptr<RequestHandler::Snapshot> RequestHandler::LoadSnapshot(const serialize::Settings& settings) const {
     serialize::Serializator serializator(settings);
-    
+
+    auto db = make_shared<TransportCatalogue>();
+    auto snapshot = make_shared<Snapshot>();
     optional<renderer::RenderSettings> render_settings;
 
-    serializator.Deserialize(const_cast<TransportCatalogue&>(db_), render_settings, router_);
+    // повреждённый файл не должен ронять сервер: такая база просто не загружается
+    try {
+        if (!serializator.Deserialize(*db, render_settings, snapshot->router)) {
+            cerr << "Can't load the base: "s << settings.file.string() << endl;
+            return nullptr;
+        }
+    } catch (const exception& error) {
+        cerr << "Can't load the base: "s << error.what() << endl;
+        return nullptr;
+    }
+
+    snapshot->db = move(db);
 
-    if (router_) {
-        routing_settings_ = router_->GetSettings();
+    if (snapshot->router) {
+        snapshot->routing_settings = snapshot->router->GetSettings();
     }
 
     if (render_settings) {
-        SetRenderer(render_settings.value());
+        snapshot->map->renderer = MakeRenderer(*snapshot->db, move(render_settings.value()));
     }
+
+    if (auto map = serializator.LoadMap()) {
+        snapshot->map->svg = move(map.value());
+    }
+
+    return snapshot;
+}
+
+bool RequestHandler::Deserialize(serialize::Settings settings) {
+    lock_guard lock(reload_mutex_);
+
+    settings_ = move(settings);
+
+    auto snapshot = LoadSnapshot(settings_);
+    if (!snapshot) {
+        return false;
+    }
+
+    Publish(move(snapshot));
+    return true;
+}
+
+// Новая версия собирается целиком, пока запросы обслуживаются старой, и публикуется одной заменой указателя
+bool RequestHandler::Reload() {
+    lock_guard lock(reload_mutex_);
+
+    auto snapshot = LoadSnapshot(settings_);
+    if (!snapshot) {
+        return false;
+    }
+
+    Publish(move(snapshot));
+    return true;
 }
 
-} // transport
\ No newline at end of file
+} // transport
@@ -1,8 +1,10 @@
 #pragma once
 
 #include <memory>
+#include <mutex>
+#include <ostream>
 
-#include "json_builder.h"
+#include "json.h"
 #include "map_renderer.h"
 #include "serialization.h"
 #include "transport_catalogue.h"
@@ -12,38 +14,94 @@ namespace transport {
 
 class RequestHandler {
 public:
-    using Route = route::TransportRouter::TransportRoute;
-
     RequestHandler(const TransportCatalogue& db);
 
     std::optional<BusStat> GetBusStat(const std::string& bus_name) const;
 
-    const std::set<std::string_view>* GetBusesThroughStop(const std::string& stop_name) const;
-
-    const svg::Document& RenderMap() const;
-    std::optional<RequestHandler::Route> BuildRoute(const std::string &from, const std::string &to) const;
-
-    json::Document GetJsonResponse(const json::Array& requests) const;
+    void WriteJsonResponse(const json::Array& requests, std::ostream& out, size_t threads_count = 1) const;
+    void WriteResponse(const json::Dict& request, json::Writer& writer) const;
 
 
     bool SetRouter() const;
-    bool ResetRouter() const;
+    // Публикует версию базы с тем же каталогом и картой и заново построенным маршрутизатором
+    bool ResetRouter();
     void SetRenderer(renderer::RenderSettings render_settings);
 
-    void Serialize(serialize::Settings settings, 
-        std::optional<renderer::RenderSettings> render_settings, 
+    void Serialize(serialize::Settings settings,
+        std::optional<renderer::RenderSettings> render_settings,
         std::optional<route::RouteSettings> route_settings);
 
-    void Deserialize(serialize::Settings settings);
+    // Загружает базу из файла. Возвращает false, если файл прочитать не удалось:
+    // тогда обработчик работает с пустым каталогом
+    bool Deserialize(serialize::Settings settings);
 
-private:
-    const TransportCatalogue& db_;
-
-    mutable std::unique_ptr<route::TransportRouter> router_;
-    std::unique_ptr<renderer::MapRenderer> renderer_;
+    // Заново читает файл базы, указанный при Deserialize, и подменяет им текущую базу.
+    // Запросы, начатые раньше, дорабатывают со старой версией. Если файл прочитать
+    // не удалось, остаётся прежняя база
+    bool Reload();
 
-    std::optional<route::RouteSettings> routing_settings_;
+private:
+    // Карта строится один раз, при первом запросе. Версии базы с тем же каталогом
+    // и отрисовщиком делят её, так что замена маршрутизатора не рисует карту заново
+    struct RenderedMap {
+        std::unique_ptr<renderer::MapRenderer> renderer;
+        std::string svg;
+        std::string json; // svg, записанный строкой JSON
+        std::once_flag once;
+    };
+
+    // Всё, что нужно для ответов по одной версии базы. Версия не меняется после публикации,
+    // кроме маршрутизатора и карты, которые строятся один раз при первом запросе
+    struct Snapshot {
+        std::shared_ptr<const TransportCatalogue> db;
+        std::optional<route::RouteSettings> routing_settings;
+
+        mutable std::unique_ptr<route::TransportRouter> router;
+        mutable std::once_flag router_once;
+
+        std::shared_ptr<RenderedMap> map = std::make_shared<RenderedMap>();
+    };
+
+    // Текущая версия базы. Запрос держит её, пока не ответит, и не берёт блокировок
+    std::shared_ptr<const Snapshot> GetSnapshot() const;
+    void Publish(std::shared_ptr<Snapshot> snapshot);
+
+    // Stat-запрос, разобранный по версии базы: тип определён, а названия заменены на id.
+    // Запрос с неизвестным названием разбирается в NOT_FOUND
+    struct StatRequest {
+        enum class Type : uint8_t {
+            BUS,
+            STOP,
+            MAP,
+            ROUTE,
+            NOT_FOUND
+        };
+
+        Type type;
+        int id;
+        uint32_t from = 0; // id маршрута для BUS, id остановки для STOP и ROUTE
+        uint32_t to = 0; // id конечной остановки для ROUTE
+    };
+
+    static StatRequest DecodeRequest(const json::Dict& request, const TransportCatalogue& db);
+    static void WriteResponse(const StatRequest& request, const Snapshot& snapshot, json::Writer& writer);
+
+    std::shared_ptr<Snapshot> LoadSnapshot(const serialize::Settings& settings) const;
+    static std::unique_ptr<renderer::MapRenderer> MakeRenderer(const TransportCatalogue& db,
+        renderer::RenderSettings settings);
+
+    static bool SetRouter(const Snapshot& snapshot);
+    static std::string RenderSvg(renderer::MapRenderer& renderer);
+    static const RenderedMap& GetMap(const Snapshot& snapshot);
+
+    // Окно запросов, ответы на которые готовятся параллельно и затем пишутся по порядку
+    static constexpr size_t RESPONSE_WINDOW = 1 << 14;
+
+    std::shared_ptr<const Snapshot> snapshot_;
+
+    serialize::Settings settings_;
+    std::mutex reload_mutex_;
 };
 
 
-} // transport
\ No newline at end of file
+} // transport
@@ -0,0 +1,478 @@
+#include "request_server.h"
+
+#include "parallel.h"
+
+#include <algorithm>
+#include <mutex>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+
+#ifdef __linux__
+#include <cerrno>
+#include <memory>
+#include <system_error>
+#include <unordered_map>
+#include <vector>
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#define TC_HAS_EPOLL
+#endif
+
+using namespace std;
+
+namespace transport {
+
+namespace {
+
+bool IsBlank(string_view line) {
+    return all_of(line.begin(), line.end(), [](char c) {
+        return c == ' ' || c == '\t' || c == '\r';
+    });
+}
+
+string MakeReloadAnswer(bool is_reloaded, int request_id) {
+    ostringstream answer;
+    {
+        json::Writer writer(answer, json::Writer::COMPACT);
+        writer.StartDict()
+            .Key("reloaded"sv).Value(is_reloaded)
+            .Key("request_id"sv).Value(request_id)
+            .EndDict();
+    }
+    return answer.str();
+}
+
+string MakeErrorAnswer(string_view message, optional<int> request_id = nullopt) {
+    ostringstream answer;
+    {
+        json::Writer writer(answer, json::Writer::COMPACT);
+        writer.StartDict().Key("error_message"sv).Value(message);
+        if (request_id) {
+            writer.Key("request_id"sv).Value(*request_id);
+        }
+        writer.EndDict();
+    }
+    return answer.str();
+}
+
+#ifdef TC_HAS_EPOLL
+
+// Наибольшая длина строки запроса, после которой соединение закрывается
+constexpr size_t MAX_LINE_SIZE = 1 << 26;
+constexpr int MAX_EVENTS = 256;
+// Сколько клиентов поток принимает за одно пробуждение: остальных примут другие потоки
+constexpr int MAX_ACCEPTS = 16;
+
+struct Connection {
+    uint64_t id = 0; // номер отличает соединение от прежнего с тем же дескриптором
+    string input;
+    string output;
+    size_t output_offset = 0;
+    uint32_t events = EPOLLIN; // события, на которые подписан сокет
+    bool is_closing = false; // клиент закончил передачу
+    size_t pending_replies = 0; // ответы, которые ещё готовятся в другом потоке
+    RequestServer::Reply reply;
+};
+
+[[noreturn]] void ThrowSystemError(const char* what) {
+    throw system_error(errno, generic_category(), what);
+}
+
+// Ответы, готовые в других потоках. Поток соединений забирает их, когда просыпается по wake_fd
+struct Mailbox {
+    struct Letter {
+        int fd;
+        uint64_t connection_id;
+        string answer;
+    };
+
+    Mailbox() : wake_fd(::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) {
+        if (wake_fd < 0) {
+            ThrowSystemError("eventfd");
+        }
+    }
+
+    ~Mailbox() {
+        ::close(wake_fd);
+    }
+
+    void Post(Letter letter) {
+        {
+            lock_guard lock(letters_mutex);
+            letters.push_back(move(letter));
+        }
+        const uint64_t one = 1;
+        [[maybe_unused]] const ssize_t size = ::write(wake_fd, &one, sizeof(one));
+    }
+
+    vector<Letter> Take() {
+        uint64_t count;
+        [[maybe_unused]] const ssize_t size = ::read(wake_fd, &count, sizeof(count));
+
+        vector<Letter> result;
+        lock_guard lock(letters_mutex);
+        result.swap(letters);
+        return result;
+    }
+
+    const int wake_fd;
+    mutex letters_mutex;
+    vector<Letter> letters;
+};
+
+void AnswerLine(Connection& connection, string_view line, const RequestServer& server) {
+    string answer = server.HandleLine(line, connection.reply);
+    if (answer.empty()) {
+        ++connection.pending_replies;
+        return;
+    }
+    connection.output += answer;
+    connection.output += '\n';
+}
+
+// Отвечает на полученные целиком строки. Возвращает false, если недочитанная
+// строка длиннее MAX_LINE_SIZE и соединение надо закрыть
+bool AnswerLines(Connection& connection, const RequestServer& server) {
+    size_t line_begin = 0;
+    for (size_t line_end = connection.input.find('\n');
+        line_end != string::npos;
+        line_end = connection.input.find('\n', line_begin)) {
+
+        const string_view line(connection.input.data() + line_begin, line_end - line_begin);
+        if (!IsBlank(line)) {
+            AnswerLine(connection, line, server);
+        }
+        line_begin = line_end + 1;
+    }
+    connection.input.erase(0, line_begin);
+
+    return connection.input.size() <= MAX_LINE_SIZE;
+}
+
+// Дочитывает всё доступное и отвечает на полученные целиком строки.
+// Строки разбираются после каждого чтения, поэтому буфер не растёт больше одной строки.
+// Возвращает false, если соединение надо закрыть
+bool ReadRequests(int fd, Connection& connection, const RequestServer& server) {
+    char buffer[1 << 16];
+
+    for (;;) {
+        const ssize_t size = ::read(fd, buffer, sizeof(buffer));
+        if (size > 0) {
+            connection.input.append(buffer, static_cast<size_t>(size));
+            if (!AnswerLines(connection, server)) {
+                return false;
+            }
+        } else if (size == 0) {
+            connection.is_closing = true;
+            break;
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            break;
+        } else if (errno != EINTR) {
+            return false;
+        }
+    }
+
+    // последняя строка может быть без перевода строки
+    if (connection.is_closing && !IsBlank(connection.input)) {
+        AnswerLine(connection, connection.input, server);
+        connection.input.clear();
+    }
+
+    return true;
+}
+
+// Отправляет накопленные ответы, пока сокет их принимает.
+// Возвращает false, если соединение надо закрыть: клиент закончил передачу и ждать больше нечего
+bool WriteAnswers(int fd, Connection& connection) {
+    while (connection.output_offset < connection.output.size()) {
+        const ssize_t size = ::send(fd, connection.output.data() + connection.output_offset,
+            connection.output.size() - connection.output_offset, MSG_NOSIGNAL);
+
+        if (size >= 0) {
+            connection.output_offset += static_cast<size_t>(size);
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return true;
+        } else if (errno != EINTR) {
+            return false;
+        }
+    }
+
+    connection.output.clear();
+    connection.output_offset = 0;
+    return !connection.is_closing || connection.pending_replies > 0;
+}
+
+#endif
+
+} // namespace
+
+RequestServer::RequestServer(RequestHandler& handler, size_t threads_count)
+    : handler_(handler), threads_count_(threads_count) {
+}
+
+RequestServer::~RequestServer() {
+    WaitReload();
+}
+
+string RequestServer::HandleLine(string_view line, const Reply& reply) const {
+    try {
+        // строка запроса обычно короткая, её документ помещается в буфер на стеке
+        char buffer[1 << 14];
+        pmr::monotonic_buffer_resource arena(buffer, sizeof(buffer));
+        const json::Document document = json::Load(line, &arena);
+        const json::Node& root = document.GetRoot();
+
+        if (root.IsDict()) {
+            if (const auto& request = root.AsDict(); request.at("type"sv).AsString() == "Reload"sv) {
+                return StartReload(request.at("id"sv).AsInt(), reply);
+            }
+        }
+
+        ostringstream answer;
+        {
+            json::Writer writer(answer, json::Writer::COMPACT);
+
+            if (root.IsArray()) {
+                writer.StartArray();
+                for (const auto& request : root.AsArray()) {
+                    handler_.WriteResponse(request.AsDict(), writer);
+                }
+                writer.EndArray();
+            } else {
+                handler_.WriteResponse(root.AsDict(), writer);
+            }
+        }
+        return answer.str();
+
+    } catch (const exception& error) {
+        return MakeErrorAnswer(error.what());
+    }
+}
+
+// Вторая перезагрузка, пришедшая во время первой, отклоняется, а не ждёт её в очереди
+string RequestServer::StartReload(int request_id, Reply reply) const {
+    if (is_reloading_.exchange(true)) {
+        return MakeErrorAnswer("Reload is already running"sv, request_id);
+    }
+
+    // прошлый поток загрузки уже закончил работу, осталось его дождаться
+    WaitReload();
+    reload_thread_ = thread([this, request_id, reply = move(reply)] {
+        const bool is_reloaded = handler_.Reload();
+        reply(MakeReloadAnswer(is_reloaded, request_id));
+        is_reloading_.store(false);
+    });
+    return {};
+}
+
+void RequestServer::WaitReload() const {
+    if (reload_thread_.joinable()) {
+        reload_thread_.join();
+    }
+}
+
+// Пока во входном буфере есть строки, ответы копятся, чтобы не сбрасывать вывод на каждую.
+// Ответ на перезагрузку пишется из потока загрузки, поэтому вывод защищён мьютексом
+void RequestServer::ServeStream(istream& in, ostream& out) const {
+    mutex out_mutex;
+    const Reply reply = [&out, &out_mutex](string answer) {
+        lock_guard lock(out_mutex);
+        out << answer << '\n';
+        out.flush();
+    };
+
+    string line;
+
+    while (getline(in, line)) {
+        string answer;
+        if (!IsBlank(line)) {
+            answer = HandleLine(line, reply);
+        }
+
+        lock_guard lock(out_mutex);
+        if (!answer.empty()) {
+            out << answer << '\n';
+        }
+        if (in.rdbuf()->in_avail() <= 0) {
+            out.flush();
+        }
+    }
+
+    WaitReload();
+    out.flush();
+}
+
+void RequestServer::ServeSocket(const string& socket_path) const {
+#ifdef TC_HAS_EPOLL
+    sockaddr_un address{};
+    if (socket_path.size() >= sizeof(address.sun_path)) {
+        throw invalid_argument("socket path is too long"s);
+    }
+    address.sun_family = AF_UNIX;
+    copy(socket_path.begin(), socket_path.end(), address.sun_path);
+
+    // сокет, оставшийся от прошлого запуска, удаляется; другие файлы не трогаем
+    struct stat file_stat;
+    if (::stat(socket_path.c_str(), &file_stat) == 0 && S_ISSOCK(file_stat.st_mode)) {
+        ::unlink(socket_path.c_str());
+    }
+
+    const int listen_fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listen_fd < 0) {
+        ThrowSystemError("socket");
+    }
+
+    if (::bind(listen_fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) < 0
+        || ::listen(listen_fd, SOMAXCONN) < 0) {
+        const int error = errno;
+        ::close(listen_fd);
+        throw system_error(error, generic_category(), "bind"s);
+    }
+
+    const size_t threads_count = parallel::ResolveThreadsCount(threads_count_);
+
+    parallel::ForEachChunk(threads_count, threads_count, [this, listen_fd](size_t, size_t, size_t) {
+        ServeConnections(listen_fd);
+    });
+
+    ::close(listen_fd);
+#else
+    (void)socket_path;
+    throw runtime_error("socket server is supported only on Linux"s);
+#endif
+}
+
+// Каждый поток ждёт новых клиентов на общем сокете (EPOLLEXCLUSIVE будит только один поток)
+// и сам обслуживает принятые соединения, так что соединения потоков не пересекаются
+void RequestServer::ServeConnections(int listen_fd) const {
+#ifdef TC_HAS_EPOLL
+    const int epoll_fd = ::epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd < 0) {
+        ThrowSystemError("epoll_create1");
+    }
+
+    epoll_event listen_event{};
+    listen_event.events = EPOLLIN | EPOLLEXCLUSIVE;
+    listen_event.data.fd = listen_fd;
+    if (::epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &listen_event) < 0) {
+        ThrowSystemError("epoll_ctl");
+    }
+
+    const auto mailbox = make_shared<Mailbox>();
+    epoll_event wake_event{};
+    wake_event.events = EPOLLIN;
+    wake_event.data.fd = mailbox->wake_fd;
+    if (::epoll_ctl(epoll_fd, EPOLL_CTL_ADD, mailbox->wake_fd, &wake_event) < 0) {
+        ThrowSystemError("epoll_ctl");
+    }
+
+    unordered_map<int, Connection> connections;
+    uint64_t last_connection_id = 0;
+    vector<epoll_event> events(MAX_EVENTS);
+
+    auto close_connection = [&](int fd) {
+        ::epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+        ::close(fd);
+        connections.erase(fd);
+    };
+
+    // Отправляет ответы и переподписывает сокет на нужные события
+    auto write_answers = [&](int fd, Connection& connection) {
+        if (!WriteAnswers(fd, connection)) {
+            close_connection(fd);
+            return;
+        }
+
+        // пока ответы не ушли, ждём готовности сокета к записи; закрывающееся соединение больше не читаем
+        uint32_t client_events = connection.is_closing ? 0u : static_cast<uint32_t>(EPOLLIN);
+        if (connection.output_offset < connection.output.size()) {
+            client_events |= EPOLLOUT;
+        }
+
+        if (client_events != connection.events) {
+            epoll_event client_event{};
+            client_event.events = client_events;
+            client_event.data.fd = fd;
+            ::epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &client_event);
+            connection.events = client_events;
+        }
+    };
+
+    for (;;) {
+        const int ready = ::epoll_wait(epoll_fd, events.data(), MAX_EVENTS, -1);
+        if (ready < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            ThrowSystemError("epoll_wait");
+        }
+
+        for (int i = 0; i < ready; ++i) {
+            const int fd = events[i].data.fd;
+
+            if (fd == listen_fd) {
+                int client_fd;
+                for (int accepted = 0; accepted < MAX_ACCEPTS
+                    && (client_fd = ::accept4(listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0;
+                    ++accepted) {
+                    epoll_event client_event{};
+                    client_event.events = EPOLLIN;
+                    client_event.data.fd = client_fd;
+
+                    if (::epoll_ctl(epoll_fd, EPOLL_CTL_ADD, client_fd, &client_event) < 0) {
+                        ::close(client_fd);
+                        continue;
+                    }
+                    Connection& connection = connections[client_fd];
+                    connection.id = ++last_connection_id;
+                    connection.reply = [mailbox, client_fd, id = connection.id](string answer) {
+                        mailbox->Post({client_fd, id, move(answer)});
+                    };
+                }
+                continue;
+            }
+
+            // ответ, готовый в другом потоке, отдаём соединению, если оно ещё открыто
+            if (fd == mailbox->wake_fd) {
+                for (auto& letter : mailbox->Take()) {
+                    const auto it = connections.find(letter.fd);
+                    if (it == connections.end() || it->second.id != letter.connection_id) {
+                        continue;
+                    }
+                    Connection& connection = it->second;
+                    connection.output += letter.answer;
+                    connection.output += '\n';
+                    --connection.pending_replies;
+                    write_answers(letter.fd, connection);
+                }
+                continue;
+            }
+
+            Connection& connection = connections.at(fd);
+            const uint32_t flags = events[i].events;
+
+            bool is_alive = (flags & EPOLLERR) == 0;
+            if (is_alive && (flags & (EPOLLIN | EPOLLHUP))) {
+                is_alive = ReadRequests(fd, connection, *this);
+            }
+            // клиент закрыл сокет целиком: ответы отправлять некуда, а EPOLLHUP будет приходить снова
+            if (!is_alive || (flags & EPOLLHUP)) {
+                close_connection(fd);
+                continue;
+            }
+
+            write_answers(fd, connection);
+        }
+    }
+#else
+    (void)listen_fd;
+#endif
+}
+
+} // transport
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <thread>
+
+#include "request_handler.h"
+
+namespace transport {
+
+// Отвечает на запросы к загруженной базе без перезапуска программы.
+// Запросы приходят построчно (NDJSON): строка - словарь stat-запроса или массив таких словарей.
+// Ответ на строку - одна строка с тем же JSON, что выводит process_requests, без отступов.
+// Запрос {"id": ..., "type": "Reload"} перечитывает файл базы в отдельном потоке, не прерывая
+// обработку остальных запросов; ответ на него приходит, когда загрузка закончится
+class RequestServer {
+public:
+    // Отправляет ответ, готовый позже остальных, без перевода строки. Может вызываться из другого потока
+    using Reply = std::function<void(std::string answer)>;
+
+    RequestServer(RequestHandler& handler, size_t threads_count);
+    ~RequestServer();
+
+    // Читает запросы из in, пока он не закончится, и пишет ответы в out
+    void ServeStream(std::istream& in, std::ostream& out) const;
+
+    // Принимает клиентов на Unix-сокете socket_path. Соединения распределяются между
+    // threads_count потоками, каждый из которых обслуживает свои соединения через epoll
+    void ServeSocket(const std::string& socket_path) const;
+
+    // Ответ на одну строку запроса, без перевода строки. Пустая строка значит,
+    // что ответ будет передан в reply, когда закончится перезагрузка базы
+    std::string HandleLine(std::string_view line, const Reply& reply) const;
+
+private:
+    void ServeConnections(int listen_fd) const;
+
+    // Запускает перезагрузку базы, если она ещё не идёт, иначе сразу возвращает ответ с ошибкой
+    std::string StartReload(int request_id, Reply reply) const;
+    void WaitReload() const;
+
+    RequestHandler& handler_;
+    size_t threads_count_;
+
+    mutable std::atomic<bool> is_reloading_{false};
+    mutable std::thread reload_thread_;
+};
+
+} // transport
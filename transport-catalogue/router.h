@@ -1,12 +1,18 @@
 #pragma once
 
+#include "contraction_hierarchy.h"
 #include "graph.h"
+#include "parallel.h"
 
 #include <algorithm>
 #include <cassert>
 #include <cstdint>
 #include <iterator>
+#include <functional>
+#include <limits>
+#include <memory>
 #include <optional>
+#include <queue>
 #include <stdexcept>
 #include <unordered_map>
 #include <utility>
@@ -15,13 +21,32 @@
 
 namespace graph {
 
+enum class RouterMode {
+    ALL_PAIRS, // таблица кратчайших путей между всеми парами вершин (Флойд-Уоршелл)
+    DIJKSTRA,  // поиск кратчайшего пути по запросу, без предрасчёта
+    A_STAR,    // поиск по запросу с оценкой оставшегося пути (эвристикой)
+    CONTRACTION_HIERARCHY, // предрасчёт иерархии сжатий, двунаправленный поиск по запросу
+};
+
+// Вес в таблице всех пар хранится скаляром. Для составных весов
+// нужна специализация, выделяющая из веса сравниваемую величину
 template <typename Weight>
-class Router {
-private:
-    using Graph = DirectedWeightedGraph<Weight>;
+struct RouteTableTraits {
+    using Value = Weight;
+
+    static Value ToValue(const Weight& weight) {
+        return weight;
+    }
+    static Weight FromValue(Value value) {
+        return value;
+    }
+};
 
+template <typename Weight, typename Graph = DirectedWeightedGraph<Weight>>
+class Router {
 public:
     explicit Router(const Graph& graph, bool initialize = true);
+    Router(const Graph& graph, RouterMode mode, bool initialize = true, size_t threads_count = 1);
 
     struct RouteInfo {
         Weight weight;
@@ -30,56 +55,140 @@ public:
 
     std::optional<RouteInfo> BuildRoute(VertexId from, VertexId to) const;
 
-    struct RouteInternalData {
-        Weight weight;
-        std::optional<EdgeId> prev_edge;
+    using Traits = RouteTableTraits<Weight>;
+    using WeightValue = typename Traits::Value;
+
+    static constexpr WeightValue UNREACHABLE = std::numeric_limits<WeightValue>::max();
+    static constexpr std::uint32_t NO_EDGE = std::numeric_limits<std::uint32_t>::max();
+
+    // Матрицы vertex_count x vertex_count, хранящиеся построчно: вес кратчайшего пути
+    // (UNREACHABLE, если пути нет) и последнее ребро пути (NO_EDGE для пустого пути)
+    struct RoutesInternalData {
+        std::vector<WeightValue> weights;
+        std::vector<std::uint32_t> prev_edges;
     };
-    using RoutesInternalData = std::vector<std::vector<std::optional<RouteInternalData>>>;
+    using Arc = typename ContractionHierarchy<Weight>::Arc;
+
+    // Эвристика должна быть допустимой и монотонной: не превышать
+    // вес кратчайшего пути до цели и не убывать быстрее веса ребра
+    using Heuristic = std::function<Weight(VertexId from, VertexId to)>;
+
+    RouterMode GetMode() const {
+        return mode_;
+    }
+
+    void SetHeuristic(Heuristic heuristic) {
+        heuristic_ = std::move(heuristic);
+    }
+
+    size_t GetVertexCount() const {
+        return vertex_count_;
+    }
+
+    // Таблица всех пар во внешней памяти, например в отображённом файле базы.
+    // owner удерживает память, пока жив маршрутизатор
+    void SetRoutesInternalDataView(const WeightValue* weights, const std::uint32_t* prev_edges,
+                                   std::shared_ptr<const void> owner) {
+        routes_view_ = RoutesInternalDataView{weights, prev_edges, std::move(owner)};
+    }
 
 private:
+    // Ширина полосы столбцов: строка vertex_through в пределах полосы
+    // остаётся в кэше, пока по ней релаксируются все строки потока
+    static constexpr size_t TILE_SIZE = 512;
+
+    struct RoutesInternalDataView {
+        const WeightValue* weights = nullptr;
+        const std::uint32_t* prev_edges = nullptr;
+        std::shared_ptr<const void> owner;
+    };
+
+    void CheckEdgesWeights(const Graph& graph) const {
+        for (const auto& edge : graph.GetEdges()) {
+            if (edge.weight < ZERO_WEIGHT) {
+                throw std::domain_error("Edges' weights should be non-negative");
+            }
+        }
+    }
 
     void InitializeRoutesInternalData(const Graph& graph) {
-        const size_t vertex_count = graph.GetVertexCount();
-        for (VertexId vertex = 0; vertex < vertex_count; ++vertex) {
-            routes_internal_data_[vertex][vertex] = RouteInternalData{ZERO_WEIGHT, std::nullopt};
+        auto& [weights, prev_edges] = routes_internal_data_;
+
+        for (VertexId vertex = 0; vertex < vertex_count_; ++vertex) {
+            const size_t row = vertex * vertex_count_;
+            weights[row + vertex] = Traits::ToValue(ZERO_WEIGHT);
+
             for (const EdgeId edge_id : graph.GetIncidentEdges(vertex)) {
                 const auto& edge = graph.GetEdge(edge_id);
                 if (edge.weight < ZERO_WEIGHT) {
                     throw std::domain_error("Edges' weights should be non-negative");
                 }
-                auto& route_internal_data = routes_internal_data_[vertex][edge.to];
-                if (!route_internal_data || route_internal_data->weight > edge.weight) {
-                    route_internal_data = RouteInternalData{edge.weight, edge_id};
+                const WeightValue edge_weight = Traits::ToValue(edge.weight);
+                if (edge_weight < weights[row + edge.to]) {
+                    weights[row + edge.to] = edge_weight;
+                    prev_edges[row + edge.to] = static_cast<std::uint32_t>(edge_id);
                 }
             }
         }
     }
 
-    void RelaxRoute(VertexId vertex_from, VertexId vertex_to, const RouteInternalData& route_from,
-                    const RouteInternalData& route_to) {
-        auto& route_relaxing = routes_internal_data_[vertex_from][vertex_to];
-        const Weight candidate_weight = route_from.weight + route_to.weight;
-        if (!route_relaxing || candidate_weight < route_relaxing->weight) {
-            route_relaxing = {candidate_weight,
-                              route_to.prev_edge ? route_to.prev_edge : route_from.prev_edge};
-        }
+    // При фиксированной vertex_through строки vertex_from независимы: строка и столбец
+    // vertex_through не меняются. Каждый поток получает свой диапазон строк на всё время
+    // расчёта и проходит все вершины vertex_through, синхронизируясь с остальными на барьере
+    void RelaxRoutesInternalData(size_t threads_count) {
+        parallel::Barrier barrier(parallel::ChunksCount(vertex_count_, threads_count));
+
+        parallel::ForEachChunk(vertex_count_, threads_count, [&](size_t begin, size_t end, size_t) {
+            for (VertexId vertex_through = 0; vertex_through < vertex_count_; ++vertex_through) {
+                RelaxRowsThroughVertex(begin, end, vertex_through);
+                barrier.Wait();
+            }
+        });
     }
 
-    void RelaxRoutesInternalDataThroughVertex(size_t vertex_count, VertexId vertex_through) {
-        for (VertexId vertex_from = 0; vertex_from < vertex_count; ++vertex_from) {
-            if (const auto& route_from = routes_internal_data_[vertex_from][vertex_through]) {
-                for (VertexId vertex_to = 0; vertex_to < vertex_count; ++vertex_to) {
-                    if (const auto& route_to = routes_internal_data_[vertex_through][vertex_to]) {
-                        RelaxRoute(vertex_from, vertex_to, *route_from, *route_to);
+    void RelaxRowsThroughVertex(VertexId rows_begin, VertexId rows_end, VertexId vertex_through) {
+        auto& [weights, prev_edges] = routes_internal_data_;
+        const WeightValue* weights_through = &weights[vertex_through * vertex_count_];
+        const std::uint32_t* prev_edges_through = &prev_edges[vertex_through * vertex_count_];
+
+        for (VertexId tile_begin = 0; tile_begin < vertex_count_; tile_begin += TILE_SIZE) {
+            const VertexId tile_end = std::min<VertexId>(tile_begin + TILE_SIZE, vertex_count_);
+
+            for (VertexId vertex_from = rows_begin; vertex_from < rows_end; ++vertex_from) {
+                WeightValue* weights_from = &weights[vertex_from * vertex_count_];
+                std::uint32_t* prev_edges_from = &prev_edges[vertex_from * vertex_count_];
+
+                const WeightValue weight_through = weights_from[vertex_through];
+                if (weight_through == UNREACHABLE) {
+                    continue;
+                }
+                const std::uint32_t prev_edge_through = prev_edges_from[vertex_through];
+
+                for (VertexId vertex_to = tile_begin; vertex_to < tile_end; ++vertex_to) {
+                    if (weights_through[vertex_to] == UNREACHABLE) {
+                        continue;
+                    }
+                    const WeightValue candidate_weight = weight_through + weights_through[vertex_to];
+                    if (candidate_weight < weights_from[vertex_to]) {
+                        weights_from[vertex_to] = candidate_weight;
+                        prev_edges_from[vertex_to] = prev_edges_through[vertex_to] != NO_EDGE
+                            ? prev_edges_through[vertex_to] : prev_edge_through;
                     }
                 }
             }
         }
     }
 
+    std::optional<RouteInfo> BuildRouteOnDemand(VertexId from, VertexId to) const;
+
     static constexpr Weight ZERO_WEIGHT{};
     const Graph& graph_;
+    RouterMode mode_;
+    size_t vertex_count_;
+    Heuristic heuristic_;
     RoutesInternalData routes_internal_data_;
+    RoutesInternalDataView routes_view_;
+    ContractionHierarchy<Weight> contraction_hierarchy_;
 public:
     RoutesInternalData& GetRoutesInternalData() {
         return routes_internal_data_;
@@ -87,43 +196,166 @@ public:
     const RoutesInternalData& GetRoutesInternalData() const {
         return routes_internal_data_;
     }
+    ContractionHierarchy<Weight>& GetContractionHierarchy() {
+        return contraction_hierarchy_;
+    }
+    const ContractionHierarchy<Weight>& GetContractionHierarchy() const {
+        return contraction_hierarchy_;
+    }
 };
 
-template <typename Weight>
-Router<Weight>::Router(const Graph& graph, bool initialize)
+template <typename Weight, typename Graph>
+Router<Weight, Graph>::Router(const Graph& graph, bool initialize)
+    : Router(graph, RouterMode::ALL_PAIRS, initialize) {
+}
+
+template <typename Weight, typename Graph>
+Router<Weight, Graph>::Router(const Graph& graph, RouterMode mode, bool initialize,
+                              size_t threads_count)
     : graph_(graph)
-    , routes_internal_data_(graph.GetVertexCount(),
-                            std::vector<std::optional<RouteInternalData>>(graph.GetVertexCount()))
+    , mode_(mode)
+    , vertex_count_(graph.GetVertexCount())
 {
+    if (mode_ == RouterMode::CONTRACTION_HIERARCHY) {
+        if (initialize) {
+            contraction_hierarchy_ = ContractionHierarchy<Weight>(graph);
+        }
+        return;
+    }
+
+    if (mode_ != RouterMode::ALL_PAIRS) {
+        if (initialize) {
+            CheckEdgesWeights(graph);
+        }
+        return;
+    }
+
+    if (graph.GetEdgeCount() >= NO_EDGE) {
+        throw std::length_error("Too many edges for the all-pairs table");
+    }
+
     if (initialize) {
+        routes_internal_data_.weights.assign(vertex_count_ * vertex_count_, UNREACHABLE);
+        routes_internal_data_.prev_edges.assign(vertex_count_ * vertex_count_, NO_EDGE);
+
         InitializeRoutesInternalData(graph);
+        RelaxRoutesInternalData(threads_count);
+    }
+}
 
-        const size_t vertex_count = graph.GetVertexCount();
-        for (VertexId vertex_through = 0; vertex_through < vertex_count; ++vertex_through) {
-            RelaxRoutesInternalDataThroughVertex(vertex_count, vertex_through);
+template <typename Weight, typename Graph>
+std::optional<typename Router<Weight, Graph>::RouteInfo>
+Router<Weight, Graph>::BuildRoute(VertexId from, VertexId to) const {
+    if (mode_ == RouterMode::CONTRACTION_HIERARCHY) {
+        auto route = contraction_hierarchy_.BuildRoute(from, to);
+        if (!route) {
+            return std::nullopt;
         }
+        return RouteInfo{route->weight, std::move(route->edges)};
     }
+
+    if (mode_ != RouterMode::ALL_PAIRS) {
+        return BuildRouteOnDemand(from, to);
+    }
+
+    if (from >= vertex_count_ || to >= vertex_count_) {
+        throw std::out_of_range("Vertex id is out of range");
+    }
+
+    const WeightValue* weights = routes_view_.weights
+        ? routes_view_.weights : routes_internal_data_.weights.data();
+    const std::uint32_t* prev_edges = routes_view_.prev_edges
+        ? routes_view_.prev_edges : routes_internal_data_.prev_edges.data();
+
+    const size_t row = from * vertex_count_;
+    if (weights[row + to] == UNREACHABLE) {
+        return std::nullopt;
+    }
+
+    // таблица может быть прочитана из файла, поэтому номера рёбер проверяются
+    std::vector<EdgeId> edges;
+    for (std::uint32_t edge_id = prev_edges[row + to];
+         edge_id != NO_EDGE;
+         edge_id = prev_edges[row + graph_.GetEdge(edge_id).from])
+    {
+        if (edge_id >= graph_.GetEdgeCount() || edges.size() >= graph_.GetEdgeCount()) {
+            throw std::runtime_error("Broken routes table");
+        }
+        edges.push_back(edge_id);
+    }
+    std::reverse(edges.begin(), edges.end());
+
+    return RouteInfo{Traits::FromValue(weights[row + to]), std::move(edges)};
 }
 
-template <typename Weight>
-std::optional<typename Router<Weight>::RouteInfo> Router<Weight>::BuildRoute(VertexId from,
-                                                                             VertexId to) const {
-    const auto& route_internal_data = routes_internal_data_.at(from).at(to);
-    if (!route_internal_data) {
+template <typename Weight, typename Graph>
+std::optional<typename Router<Weight, Graph>::RouteInfo>
+Router<Weight, Graph>::BuildRouteOnDemand(VertexId from, VertexId to) const {
+    const size_t vertex_count = graph_.GetVertexCount();
+    if (from >= vertex_count || to >= vertex_count) {
+        throw std::out_of_range("Vertex id is out of range");
+    }
+
+    using QueueItem = std::pair<Weight, VertexId>;
+    auto greater = [](const QueueItem& lhs, const QueueItem& rhs) {
+        return lhs.first > rhs.first;
+    };
+    std::priority_queue<QueueItem, std::vector<QueueItem>, decltype(greater)> queue(greater);
+
+    std::vector<std::optional<Weight>> weights(vertex_count);
+    std::vector<std::optional<EdgeId>> prev_edges(vertex_count);
+    std::vector<bool> settled(vertex_count, false);
+
+    const bool use_heuristic = mode_ == RouterMode::A_STAR && heuristic_;
+    auto estimate = [&](VertexId vertex, const Weight& weight) {
+        return use_heuristic ? weight + heuristic_(vertex, to) : weight;
+    };
+
+    weights[from] = ZERO_WEIGHT;
+    queue.push({estimate(from, ZERO_WEIGHT), from});
+
+    while (!queue.empty()) {
+        const VertexId vertex = queue.top().second;
+        queue.pop();
+
+        if (settled[vertex]) {
+            continue;
+        }
+        settled[vertex] = true;
+
+        if (vertex == to) {
+            break;
+        }
+
+        for (const EdgeId edge_id : graph_.GetIncidentEdges(vertex)) {
+            const auto& edge = graph_.GetEdge(edge_id);
+            if (settled[edge.to]) {
+                continue;
+            }
+
+            const Weight candidate_weight = *weights[vertex] + edge.weight;
+            if (!weights[edge.to] || candidate_weight < *weights[edge.to]) {
+                weights[edge.to] = candidate_weight;
+                prev_edges[edge.to] = edge_id;
+                queue.push({estimate(edge.to, candidate_weight), edge.to});
+            }
+        }
+    }
+
+    if (!weights[to]) {
         return std::nullopt;
     }
 
-    const Weight weight = route_internal_data->weight;
     std::vector<EdgeId> edges;
-    for (std::optional<EdgeId> edge_id = route_internal_data->prev_edge;
+    for (std::optional<EdgeId> edge_id = prev_edges[to];
          edge_id;
-         edge_id = routes_internal_data_[from][graph_.GetEdge(*edge_id).from]->prev_edge)
+         edge_id = prev_edges[graph_.GetEdge(*edge_id).from])
     {
         edges.push_back(*edge_id);
     }
     std::reverse(edges.begin(), edges.end());
-    
-    return RouteInfo{weight, std::move(edges)};
+
+    return RouteInfo{*weights[to], std::move(edges)};
 }
 
 }  // namespace graph
\ No newline at end of file
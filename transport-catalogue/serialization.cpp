@@ -1,16 +1,44 @@
+#include <algorithm>
+#include <array>
+#include <climits>
+#include <cstring>
 #include <fstream>
 #include <iostream>
+#include <stdexcept>
 
 #include "serialization.h"
 
 namespace serialize {
 
+namespace {
+
+// Номер из файла базы должен указывать внутрь массива из count элементов,
+// иначе файл повреждён и загрузка прерывается
+void CheckIndex(uint64_t index, size_t count, const char* message) {
+    if (index >= count) {
+        throw std::runtime_error(message);
+    }
+}
+
+} // namespace
+
 void Serializator::SaveTransportCatalogue(const TransportCatalogue& catalogue) {
     SaveStops(catalogue);
     SaveBuses(catalogue);
     SaveDistances(catalogue);
 }
 
+void Serializator::SaveMap(std::string map) {
+    proto_catalogue_.set_map(std::move(map));
+}
+
+std::optional<std::string> Serializator::LoadMap() {
+    if (proto_catalogue_.map().empty()) {
+        return std::nullopt;
+    }
+    return std::move(*proto_catalogue_.mutable_map());
+}
+
 void Serializator::SaveRenderSettings(transport::renderer::RenderSettings render_settings) {
     auto proto_settings = proto_catalogue_.mutable_render_settings();
 
@@ -36,15 +64,40 @@ void Serializator::SaveRenderSettings(transport::renderer::RenderSettings render
     }
 }
 
+// База пишется во временный файл рядом и подменяет старую переименованием: сервер,
+// который отобразил старый файл в память, продолжает читать прежние данные
 bool Serializator::Serialize() {
-    std::ofstream out_file(settings_.file, std::ios::binary);
-    
-    if (!out_file.is_open ()) {
+    std::filesystem::path temp_file = settings_.file;
+    temp_file += ".tmp";
+
+    {
+        std::ofstream out_file(temp_file, std::ios::binary | std::ios::trunc);
+
+        if (!out_file.is_open()) {
             return false;
+        }
+
+        if (settings_.format == Format::FLAT) {
+            SerializeFlat(out_file);
+        } else {
+            proto_catalogue_.SerializeToOstream(&out_file);
+        }
+
+        out_file.close();
+        if (!out_file) {
+            std::error_code error;
+            std::filesystem::remove(temp_file, error);
+            return false;
+        }
+    }
+
+    std::error_code error;
+    std::filesystem::rename(temp_file, settings_.file, error);
+    if (error) {
+        std::filesystem::remove(temp_file, error);
+        return false;
     }
 
-    proto_catalogue_.SerializeToOstream(&out_file);
-  
     return true;
 }
 
@@ -52,9 +105,18 @@ bool Serializator::Deserialize(TransportCatalogue& catalogue,
     std::optional<transport::renderer::RenderSettings>& result_settings,
     std::unique_ptr<route::TransportRouter>& router) {
     
-    std::ifstream in_file(settings_.file, std::ios::binary);
-    
-    if (!in_file.is_open() || !proto_catalogue_.ParseFromIstream(&in_file)) {
+    auto file = std::make_shared<const MappedFile>(settings_.file);
+
+    if (!file->IsOpen()) {
+        return false;
+    }
+
+    if (flat::HasFlatHeader(file->GetData(), file->GetSize())) {
+        return DeserializeFlat(file, catalogue, result_settings, router);
+    }
+
+    if (file->GetSize() > static_cast<size_t>(INT_MAX)
+        || !proto_catalogue_.ParseFromArray(file->GetData(), static_cast<int>(file->GetSize()))) {
         return false;
     }
 
@@ -70,68 +132,76 @@ bool Serializator::Deserialize(TransportCatalogue& catalogue,
 }
 
 void Serializator::SaveStops(const TransportCatalogue& catalogue) {
-    auto comp = [] (const transport::Stop* a, const transport::Stop* b) {
-        return a->id < b->id;
-    };
+    const int stops_count = catalogue.GetStopsSize();
 
-    std::set<const transport::Stop*, decltype(comp)> stops(comp);
+    for (int id = 0; id < stops_count; ++id) {
+        const auto stop = catalogue.GetStopById(id);
 
-    for (const auto& [stop_name, stop] : catalogue.GetStops()) {
-              
-        stops.insert(stop);
-    }
-    
-    
-    for (auto stop : stops) {
         proto_catalogue::Stop proto_stop;
         proto_stop.set_id(stop->id);
-        proto_stop.set_name(stop->name);
+        proto_stop.set_name(std::string(stop->name));
         *proto_stop.mutable_coordinates() = MakeProtoCoordinates(stop->coordinates);
         *proto_catalogue_.mutable_catalogue()->add_stop() = std::move(proto_stop);
     }
 }
 
+// id маршрута в базе совпадает с его id в справочнике, поэтому при загрузке маршруты добавляются по порядку
 void Serializator::SaveBuses(const TransportCatalogue &catalogue) {
-    auto& buses = catalogue.GetBuses();
-    uint32_t id = 0;
-    
-    for (auto [name, bus] : buses) {
+    const int buses_count = catalogue.GetBusesSize();
+
+    for (int id = 0; id < buses_count; ++id) {
+        const auto bus = catalogue.GetBusById(id);
+
         proto_catalogue::Bus proto_bus;
-        proto_bus.set_id(id);
-        proto_bus.set_name(bus->name);
+        proto_bus.set_id(bus->id);
+        proto_bus.set_name(std::string(bus->name));
         proto_bus.set_circular(bus->circular);
-        SaveBusStops(*bus, proto_bus, catalogue);
-        bus_id_by_name_.insert({name, id++});
+        SaveBusStops(*bus, proto_bus);
+        SaveBusStat(catalogue.GetBusStat(bus->name).value(), proto_bus);
         *proto_catalogue_.mutable_catalogue()->add_bus() = std::move(proto_bus);
     }
 }
 
-void Serializator::SaveBusStops(const transport::Bus& bus,
-    proto_catalogue::Bus& proto_bus, const TransportCatalogue& catalogue) {
-    
+void Serializator::SaveBusStops(const transport::Bus& bus, proto_catalogue::Bus& proto_bus) {
     for (auto stop : bus.bus_stops) {
-        proto_bus.add_stop_id(catalogue.GetStopId(stop->name));
+        proto_bus.add_stop_id(stop->id);
     }
 }
 
+void Serializator::SaveBusStat(const transport::BusStat& stat, proto_catalogue::Bus& proto_bus) {
+    auto proto_stat = proto_bus.mutable_stat();
+
+    proto_stat->set_all_stops(stat.all_stops);
+    proto_stat->set_unique_stops(stat.unique_stops);
+    proto_stat->set_length(stat.length);
+    proto_stat->set_curvature(stat.curvature);
+}
+
 void Serializator::SaveDistances(const TransportCatalogue& catalogue) {
-    auto &distances = catalogue.GetDistances();
-    
-    for (auto &[from_to, length] : distances) {
-        proto_catalogue::Distance proto_distance;
-        
-        proto_distance.set_stop_id_from(catalogue.GetStopId(from_to.first->name));
-        proto_distance.set_stop_id_to(catalogue.GetStopId(from_to.second->name));
-        proto_distance.set_length(length);
-        
-        *proto_catalogue_.mutable_catalogue()->add_distance() = std::move(proto_distance);
+    const int stops_count = catalogue.GetStopsSize();
+
+    for (int from = 0; from < stops_count; ++from) {
+        for (const auto& distance : catalogue.GetDistancesFrom(from)) {
+            proto_catalogue::Distance proto_distance;
+
+            proto_distance.set_stop_id_from(from);
+            proto_distance.set_stop_id_to(distance.to);
+            proto_distance.set_length(distance.meters);
+
+            *proto_catalogue_.mutable_catalogue()->add_distance() = std::move(proto_distance);
+        }
     }
 }
 
 void Serializator::SaveTransportRouter(const route::TransportRouter& router) {
     SaveTransportRouterSettings(router.GetSettings());
     SaveGraph(router.GetGraph());
-    SaveRouter(router.GetRouter());
+
+    if (router.GetRouter()->GetMode() == graph::RouterMode::ALL_PAIRS) {
+        SaveRouter(router.GetRouter());
+    } else if (router.GetRouter()->GetMode() == graph::RouterMode::CONTRACTION_HIERARCHY) {
+        SaveContractionHierarchy(router.GetRouter());
+    }
 }
 
 void Serializator::SaveTransportRouterSettings(const route::RouteSettings& routing_settings) {
@@ -139,6 +209,10 @@ void Serializator::SaveTransportRouterSettings(const route::RouteSettings& routi
 
     proto_settings->set_wait_time(routing_settings.bus_wait_time);
     proto_settings->set_velocity(routing_settings.bus_velocity);
+    proto_settings->set_mode(MakeProtoRouterMode(routing_settings.router_mode));
+    proto_settings->set_graph_model(routing_settings.graph_model == route::GraphModel::STOP_EVENTS
+        ? proto_transport_router::STOP_EVENTS
+        : proto_transport_router::STOP_PAIRS);
 }
 
 void Serializator::SaveGraph(const route::TransportRouter::Graph &graph) {
@@ -153,38 +227,38 @@ void Serializator::SaveGraph(const route::TransportRouter::Graph &graph) {
         *proto_graph->add_edges() = std::move(proto_edge);
     }
 
-    for (auto &list : graph.GetIncidenceLists()) {
-        auto proto_list = proto_graph->add_incidence_lists();
-        
-        for (auto id : list) {
-            proto_list->add_edge_id(id);
-        }
-    }
-
+    proto_graph->set_vertex_count(graph.GetVertexCount());
 }
 
 void Serializator::SaveRouter(const std::unique_ptr<route::TransportRouter::Router>& router) {
     auto proto_router = proto_catalogue_.mutable_router()->mutable_router();
+    const auto& [weights, prev_edges] = router->GetRoutesInternalData();
 
-    for (const auto& data : router->GetRoutesInternalData()) {
-        proto_graph::RoutesInternalData proto_data;
-        
-        for (const auto &internal : data) {
-            proto_graph::OptionalRouteInternalData proto_internal;
-            
-            if (internal.has_value()) {
-                auto& value = internal.value();
-                auto proto_value = proto_internal.mutable_route_internal_data();
-                
-                proto_value->set_total_time(value.weight.total_time);
-                
-                if (value.prev_edge.has_value()) {
-                    proto_value->set_prev_edge(value.prev_edge.value());
-                }
-            }
-            *proto_data.add_routes_internal_data() = std::move(proto_internal);
+    proto_router->mutable_total_time()->Add(weights.begin(), weights.end());
+    proto_router->mutable_prev_edge()->Add(prev_edges.begin(), prev_edges.end());
+}
+
+void Serializator::SaveContractionHierarchy(const std::unique_ptr<route::TransportRouter::Router>& router) {
+    auto proto_hierarchy = proto_catalogue_.mutable_router()->mutable_contraction_hierarchy();
+    const auto& hierarchy = router->GetContractionHierarchy();
+
+    for (auto rank : hierarchy.GetRanks()) {
+        proto_hierarchy->add_rank(rank);
+    }
+
+    for (const auto& arc : hierarchy.GetArcs()) {
+        auto proto_arc = proto_hierarchy->add_arcs();
+
+        proto_arc->set_from(arc.from);
+        proto_arc->set_to(arc.to);
+        proto_arc->set_total_time(arc.weight.total_time);
+
+        if (arc.IsShortcut()) {
+            proto_arc->mutable_shortcut()->set_first(arc.first);
+            proto_arc->mutable_shortcut()->set_second(arc.second);
+        } else {
+            proto_arc->set_edge_id(arc.edge_id);
         }
-        *proto_router->add_routes_internal_data() = std::move(proto_data);
     }
 }
 
@@ -234,13 +308,39 @@ proto_svg::Color Serializator::MakeProtoColor(const svg::Color& color) {
 proto_graph::RouteWeight Serializator::MakeProtoWeight(const route::RouteWeight &weight) const {
     proto_graph::RouteWeight proto_weight;
     
-    proto_weight.set_bus_id(bus_id_by_name_.at(weight.bus_name));
+    proto_weight.set_bus_id(weight.bus->id);
     proto_weight.set_span_count(weight.span_count);
     proto_weight.set_total_time(weight.total_time);
     
     return proto_weight;
 }
 
+proto_transport_router::RouterMode Serializator::MakeProtoRouterMode(graph::RouterMode mode) {
+    switch (mode) {
+        case graph::RouterMode::DIJKSTRA:
+            return proto_transport_router::DIJKSTRA;
+        case graph::RouterMode::A_STAR:
+            return proto_transport_router::A_STAR;
+        case graph::RouterMode::CONTRACTION_HIERARCHY:
+            return proto_transport_router::CONTRACTION_HIERARCHY;
+        default:
+            return proto_transport_router::ALL_PAIRS;
+    }
+}
+
+graph::RouterMode Serializator::MakeRouterMode(proto_transport_router::RouterMode proto_mode) {
+    switch (proto_mode) {
+        case proto_transport_router::DIJKSTRA:
+            return graph::RouterMode::DIJKSTRA;
+        case proto_transport_router::A_STAR:
+            return graph::RouterMode::A_STAR;
+        case proto_transport_router::CONTRACTION_HIERARCHY:
+            return graph::RouterMode::CONTRACTION_HIERARCHY;
+        default:
+            return graph::RouterMode::ALL_PAIRS;
+    }
+}
+
 geo::Coordinates Serializator::MakeCoordinates(const proto_catalogue::Coordinates& proto_coordinates) {
     geo::Coordinates coordinates;
     
@@ -292,9 +392,7 @@ route::RouteWeight Serializator::MakeWeight(const TransportCatalogue& catalogue,
     
     route::RouteWeight weight;
 
-    auto route_name = catalogue.GetBuses().at(bus_name_by_id_.at(proto_weight.bus_id()));
-    
-    weight.bus_name = route_name->name;
+    weight.bus = catalogue.GetBusById(proto_weight.bus_id());
     weight.span_count = proto_weight.span_count();
     weight.total_time = proto_weight.total_time();
     
@@ -309,7 +407,7 @@ void Serializator::LoadStops(TransportCatalogue& catalogue) {
 
         auto coords = MakeCoordinates(proto_stop.coordinates());
 
-        catalogue.AddStop({proto_stop.name(), coords.lat, coords.lng});;
+        catalogue.AddStop(proto_stop.name(), coords);
     }
 }
 
@@ -318,44 +416,40 @@ void Serializator::LoadBuses(TransportCatalogue &catalogue) {
     
     for (int i = 0; i < buses_count; ++i) {
         auto& proto_bus = proto_catalogue_.catalogue().bus(i);
+        if (proto_bus.id() != static_cast<uint32_t>(i)) {
+            throw std::runtime_error("Broken bus id in the base file");
+        }
         LoadBus(catalogue, proto_bus);
-        bus_name_by_id_.insert({proto_bus.id(), proto_bus.name()});
     }
+    catalogue.Freeze();
 }
 
 void Serializator::LoadBus(TransportCatalogue& catalogue,
     const proto_catalogue::Bus& proto_bus) const {
     
-    auto stops_count = proto_bus.stop_id_size();
-    
-    std::vector<std::string> stops;
-    
-    stops.reserve(stops_count);
-    
-    for(int i = 0; i < stops_count; ++i) {
-        auto stop_name = catalogue.GetStopNameById(proto_bus.stop_id(i));
-        stops.push_back(stop_name);
-    }
+    // в базах без статистики она считается заново
+    if (proto_bus.has_stat()) {
+        const auto& proto_stat = proto_bus.stat();
+        const std::vector<transport::StopId> stops(proto_bus.stop_id().begin(), proto_bus.stop_id().end());
+
+        catalogue.AddBus(proto_bus.name(), stops, proto_bus.circular(),
+            {proto_stat.all_stops(), proto_stat.unique_stops(), proto_stat.length(), proto_stat.curvature()});
+    } else {
+        std::vector<std::string> stops;
+        stops.reserve(proto_bus.stop_id_size());
+
+        for (auto stop_id : proto_bus.stop_id()) {
+            stops.emplace_back(catalogue.GetStopNameById(stop_id));
+        }
 
-    catalogue.AddBus({proto_bus.name(), move(stops), proto_bus.circular()});
+        catalogue.AddBus({proto_bus.name(), move(stops), proto_bus.circular()});
+    }
 }
 
 void Serializator::LoadDistances(TransportCatalogue& catalogue) const {
-    std::unordered_map<std::string, std::unordered_map<std::string, int>> d_map;
-
-    auto distances_count = proto_catalogue_.catalogue().distance_size();
-    
-    for (int i = 0; i < distances_count; ++i) {
-        auto& proto_distance = proto_catalogue_.catalogue().distance(i);
-        
-        auto stop_from = catalogue.GetStopNameById(proto_distance.stop_id_from());
-        auto stop_to = catalogue.GetStopNameById(proto_distance.stop_id_to());
-
-        d_map[stop_from][stop_to] = proto_distance.length();
-    }
-
-    for (auto& [from, mp_to] : d_map) {
-        catalogue.AddDistances({move(from), move(mp_to)});
+    // в базе записаны расстояния для обоих направлений, поэтому каждое задаётся как есть
+    for (const auto& proto_distance : proto_catalogue_.catalogue().distance()) {
+        catalogue.AddDistance(proto_distance.stop_id_from(), proto_distance.stop_id_to(), proto_distance.length());
     }
 }
 
@@ -411,9 +505,14 @@ void Serializator::LoadTransportRouter(const TransportCatalogue& catalogue,
 
     LoadGraph(catalogue, transport_router->GetGraph());
 
-    transport_router->GetRouter() =
-        std::make_unique<route::TransportRouter::Router>(transport_router->GetGraph(), false);
-    LoadRouter(catalogue, transport_router->GetRouter());
+    transport_router->GetRouter() = std::make_unique<route::TransportRouter::Router>(
+        transport_router->GetGraph(), routing_settings.router_mode, false);
+
+    if (routing_settings.router_mode == graph::RouterMode::ALL_PAIRS) {
+        LoadRouter(catalogue, transport_router->GetRouter());
+    } else if (routing_settings.router_mode == graph::RouterMode::CONTRACTION_HIERARCHY) {
+        LoadContractionHierarchy(transport_router->GetGraph(), transport_router->GetRouter());
+    }
 
     transport_router->InternalInit();
 }
@@ -423,11 +522,19 @@ void Serializator::LoadTransportRouterSettings(route::RouteSettings& routing_set
 
     routing_settings.bus_wait_time = proto_settings.wait_time();
     routing_settings.bus_velocity = proto_settings.velocity();
+    routing_settings.router_mode = MakeRouterMode(proto_settings.mode());
+    routing_settings.graph_model = proto_settings.graph_model() == proto_transport_router::STOP_EVENTS
+        ? route::GraphModel::STOP_EVENTS
+        : route::GraphModel::STOP_PAIRS;
 }
 
 void Serializator::LoadGraph(const TransportCatalogue& catalogue, route::TransportRouter::Graph& graph) {
     auto &proto_graph = proto_catalogue_.router().graph();
     auto edge_count = proto_graph.edges_size();
+    const size_t vertex_count = proto_graph.vertex_count();
+
+    std::vector<graph::Edge<route::RouteWeight>> edges;
+    edges.reserve(edge_count);
 
     for (auto i = 0; i < edge_count; ++i) {
         graph::Edge<route::RouteWeight> edge;
@@ -435,61 +542,368 @@ void Serializator::LoadGraph(const TransportCatalogue& catalogue, route::Transpo
         
         edge.from = proto_edge.from();
         edge.to = proto_edge.to();
+        CheckIndex(edge.from, vertex_count, "Broken edge in the base file");
+        CheckIndex(edge.to, vertex_count, "Broken edge in the base file");
         edge.weight = MakeWeight(catalogue, proto_edge.weight());
         
-        graph.GetEdges().push_back(std::move(edge));
+        edges.push_back(std::move(edge));
     }
 
-    auto incidence_lists_count = proto_graph.incidence_lists_size();
-    
-    for (auto i = 0; i < incidence_lists_count; ++i) {
-        route::TransportRouter::Graph::IncidenceList list;
-        
-        auto &proto_list = proto_graph.incidence_lists(i);
-        auto list_count = proto_list.edge_id_size();
-        
-        for (auto j = 0; j < list_count; ++j) {
-            list.push_back(proto_list.edge_id(j));
-        }
-        
-        graph.GetIncidenceLists().push_back(list);
-    }
+    graph = route::TransportRouter::Graph(proto_graph.vertex_count(), std::move(edges));
 }
 
 void Serializator::LoadRouter(const TransportCatalogue& catalogue,
     std::unique_ptr<route::TransportRouter::Router>& router) {
     
     auto &proto_router = proto_catalogue_.router().router();
-    auto &routes_internal_data = router->GetRoutesInternalData();
+    auto &[weights, prev_edges] = router->GetRoutesInternalData();
+    const size_t cells_count = router->GetVertexCount() * router->GetVertexCount();
 
-    auto routes_internal_data_count = proto_router.routes_internal_data_size();
+    if (static_cast<size_t>(proto_router.total_time_size()) != cells_count
+        || static_cast<size_t>(proto_router.prev_edge_size()) != cells_count) {
+        throw std::runtime_error("Routes table size does not match the graph");
+    }
 
-    for (int i = 0; i < routes_internal_data_count; ++i) {
-        auto& proto_internal_data = proto_router.routes_internal_data(i);
-        auto internal_data_count = proto_internal_data.routes_internal_data_size();
-        
-        for (int j = 0; j < internal_data_count; ++j) {
-            auto& proto_optional_data = proto_internal_data.routes_internal_data(j);
-            
-            if (proto_optional_data.optional_route_internal_data_case() ==  proto_graph::OptionalRouteInternalData::kRouteInternalData) { 
-                route::TransportRouter::Router::RouteInternalData data;
-                auto& proto_data = proto_optional_data.route_internal_data();
-                data.weight.total_time = proto_data.total_time();
-                
-                if (proto_data.optional_prev_edge_case() == proto_graph::RouteInternalData::kPrevEdge) {
-                    data.prev_edge = proto_data.prev_edge();
-                } else {
-                    data.prev_edge = std::nullopt;
-                }
-                routes_internal_data[i][j] = std::move(data);
-            } else {
-                routes_internal_data[i][j] = std::nullopt;
-            }
+    weights.assign(proto_router.total_time().begin(), proto_router.total_time().end());
+    prev_edges.assign(proto_router.prev_edge().begin(), proto_router.prev_edge().end());
+}
+
+void Serializator::LoadContractionHierarchy(const route::TransportRouter::Graph& graph,
+    std::unique_ptr<route::TransportRouter::Router>& router) {
+
+    auto& proto_hierarchy = proto_catalogue_.router().contraction_hierarchy();
+    auto& hierarchy = router->GetContractionHierarchy();
+
+    auto& ranks = hierarchy.GetRanks();
+    ranks.reserve(proto_hierarchy.rank_size());
+
+    for (auto rank : proto_hierarchy.rank()) {
+        ranks.push_back(rank);
+    }
+
+    if (ranks.size() != graph.GetVertexCount()) {
+        throw std::runtime_error("Contraction hierarchy size does not match the graph");
+    }
+
+    auto& arcs = hierarchy.GetArcs();
+    arcs.reserve(proto_hierarchy.arcs_size());
+
+    for (const auto& proto_arc : proto_hierarchy.arcs()) {
+        route::TransportRouter::Router::Arc arc;
+
+        arc.from = proto_arc.from();
+        arc.to = proto_arc.to();
+
+        CheckIndex(arc.from, graph.GetVertexCount(), "Broken hierarchy arc in the base file");
+        CheckIndex(arc.to, graph.GetVertexCount(), "Broken hierarchy arc in the base file");
+
+        if (proto_arc.origin_case() == proto_transport_router::ContractionHierarchyArc::kShortcut) {
+            arc.weight.total_time = proto_arc.total_time();
+            arc.first = proto_arc.shortcut().first();
+            arc.second = proto_arc.shortcut().second();
+            // шорткат добавляется после дуг, которые заменяет, поэтому ссылается только на предыдущие
+            CheckIndex(arc.first, arcs.size(), "Broken hierarchy arc in the base file");
+            CheckIndex(arc.second, arcs.size(), "Broken hierarchy arc in the base file");
+        } else {
+            arc.edge_id = proto_arc.edge_id();
+            CheckIndex(arc.edge_id, graph.GetEdgeCount(), "Broken hierarchy arc in the base file");
+            arc.weight = graph.GetEdge(arc.edge_id).weight;
+        }
+
+        arcs.push_back(std::move(arc));
+    }
+
+    hierarchy.BuildSearchIndex();
+}
+
+namespace {
+
+uint64_t AlignSectionOffset(uint64_t offset) {
+    return (offset + flat::SECTION_ALIGNMENT - 1) / flat::SECTION_ALIGNMENT * flat::SECTION_ALIGNMENT;
+}
+
+struct SectionData {
+    const void* data = nullptr;
+    size_t size = 0;
+};
+
+template <typename Container>
+SectionData MakeSectionData(const Container& container) {
+    return {container.data(), container.size() * sizeof(*container.data())};
+}
+
+} // namespace
+
+// Плоская база собирается из уже заполненного proto_catalogue_: справочник, граф
+// и таблицы переводятся в массивы, остальное остаётся небольшим сообщением protobuf
+void Serializator::SerializeFlat(std::ostream& out) const {
+    const auto& proto_catalogue = proto_catalogue_.catalogue();
+    const auto& proto_router = proto_catalogue_.router();
+
+    std::string strings;
+    auto add_string = [&strings](const std::string& str) {
+        flat::String result{static_cast<uint32_t>(strings.size()), static_cast<uint32_t>(str.size())};
+        strings += str;
+        return result;
+    };
+
+    std::vector<flat::Stop> stops;
+    stops.reserve(proto_catalogue.stop_size());
+    for (const auto& proto_stop : proto_catalogue.stop()) {
+        stops.push_back({add_string(proto_stop.name()),
+            proto_stop.coordinates().lat(), proto_stop.coordinates().lng()});
+    }
+
+    std::vector<flat::Bus> buses;
+    std::vector<uint32_t> bus_stops;
+    buses.reserve(proto_catalogue.bus_size());
+    for (const auto& proto_bus : proto_catalogue.bus()) {
+        const auto& proto_stat = proto_bus.stat();
+        buses.push_back({add_string(proto_bus.name()), static_cast<uint32_t>(bus_stops.size()),
+            static_cast<uint32_t>(proto_bus.stop_id_size()), proto_bus.circular() ? 1u : 0u,
+            proto_stat.all_stops(), proto_stat.unique_stops(), proto_stat.length(), proto_stat.curvature()});
+        bus_stops.insert(bus_stops.end(), proto_bus.stop_id().begin(), proto_bus.stop_id().end());
+    }
+
+    std::vector<flat::Distance> distances;
+    distances.reserve(proto_catalogue.distance_size());
+    for (const auto& proto_distance : proto_catalogue.distance()) {
+        distances.push_back({proto_distance.stop_id_from(), proto_distance.stop_id_to(), proto_distance.length()});
+    }
+
+    std::vector<flat::Edge> edges;
+    edges.reserve(proto_router.graph().edges_size());
+    for (const auto& proto_edge : proto_router.graph().edges()) {
+        const auto& proto_weight = proto_edge.weight();
+        edges.push_back({proto_edge.from(), proto_edge.to(), proto_weight.bus_id(),
+            static_cast<int32_t>(proto_weight.span_count()), proto_weight.total_time()});
+    }
+
+    const auto& proto_hierarchy = proto_router.contraction_hierarchy();
+    std::vector<uint32_t> ranks(proto_hierarchy.rank().begin(), proto_hierarchy.rank().end());
+
+    std::vector<flat::Arc> arcs;
+    arcs.reserve(proto_hierarchy.arcs_size());
+    for (const auto& proto_arc : proto_hierarchy.arcs()) {
+        flat::Arc arc{proto_arc.from(), proto_arc.to(), 0, flat::NO_ARC, flat::NO_ARC, 0, proto_arc.total_time()};
+        if (proto_arc.origin_case() == proto_transport_router::ContractionHierarchyArc::kShortcut) {
+            arc.first = proto_arc.shortcut().first();
+            arc.second = proto_arc.shortcut().second();
+        } else {
+            arc.edge_id = proto_arc.edge_id();
         }
+        arcs.push_back(arc);
+    }
+
+    ProtoTransportCatalogue meta;
+    if (proto_catalogue_.has_render_settings()) {
+        *meta.mutable_render_settings() = proto_catalogue_.render_settings();
     }
+    meta.set_map(proto_catalogue_.map());
+    if (proto_catalogue_.has_router()) {
+        *meta.mutable_router()->mutable_settings() = proto_router.settings();
+        meta.mutable_router()->mutable_graph()->set_vertex_count(proto_router.graph().vertex_count());
+    }
+    const std::string meta_data = meta.SerializeAsString();
+
+    std::array<SectionData, static_cast<size_t>(flat::Section::COUNT)> sections;
+    auto set_section = [&sections](flat::Section section, SectionData data) {
+        sections[static_cast<size_t>(section)] = data;
+    };
 
+    set_section(flat::Section::META, MakeSectionData(meta_data));
+    set_section(flat::Section::STRINGS, MakeSectionData(strings));
+    set_section(flat::Section::STOPS, MakeSectionData(stops));
+    set_section(flat::Section::BUSES, MakeSectionData(buses));
+    set_section(flat::Section::BUS_STOPS, MakeSectionData(bus_stops));
+    set_section(flat::Section::DISTANCES, MakeSectionData(distances));
+    set_section(flat::Section::EDGES, MakeSectionData(edges));
+    set_section(flat::Section::ROUTES_WEIGHTS, MakeSectionData(proto_router.router().total_time()));
+    set_section(flat::Section::ROUTES_PREV_EDGES, MakeSectionData(proto_router.router().prev_edge()));
+    set_section(flat::Section::HIERARCHY_RANKS, MakeSectionData(ranks));
+    set_section(flat::Section::HIERARCHY_ARCS, MakeSectionData(arcs));
+
+    flat::Header header{};
+    std::memcpy(header.magic, flat::MAGIC, sizeof(flat::MAGIC));
+    header.version = flat::VERSION;
+    header.sections_count = static_cast<uint32_t>(flat::Section::COUNT);
+
+    uint64_t offset = AlignSectionOffset(sizeof(header));
+    for (size_t i = 0; i < sections.size(); ++i) {
+        header.sections[i] = {offset, sections[i].size};
+        offset = AlignSectionOffset(offset + sections[i].size);
+    }
+
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    uint64_t written = sizeof(header);
+
+    for (size_t i = 0; i < sections.size(); ++i) {
+        static const char padding[flat::SECTION_ALIGNMENT] = {};
+        out.write(padding, static_cast<std::streamsize>(header.sections[i].offset - written));
+        out.write(static_cast<const char*>(sections[i].data), static_cast<std::streamsize>(sections[i].size));
+        written = header.sections[i].offset + sections[i].size;
+    }
 }
 
+bool Serializator::DeserializeFlat(const std::shared_ptr<const MappedFile>& file, TransportCatalogue& catalogue,
+    std::optional<transport::renderer::RenderSettings>& result_settings,
+    std::unique_ptr<route::TransportRouter>& router) {
+
+    flat::Header header;
+    std::memcpy(&header, file->GetData(), sizeof(header));
+
+    if (header.version != flat::VERSION
+        || header.sections_count != static_cast<uint32_t>(flat::Section::COUNT)) {
+        return false;
+    }
+
+    for (const auto& range : header.sections) {
+        if (range.offset % flat::SECTION_ALIGNMENT != 0 || range.offset > file->GetSize()
+            || range.size > file->GetSize() - range.offset) {
+            return false;
+        }
+    }
+
+    const auto meta = flat::GetSection<char>(file->GetData(), header, flat::Section::META);
+    if (!proto_catalogue_.ParseFromArray(meta.begin(), static_cast<int>(meta.end() - meta.begin()))) {
+        return false;
+    }
+
+    LoadFlatCatalogue(file->GetData(), header, catalogue);
+    LoadRenderSettings(result_settings);
+    LoadFlatTransportRouter(file, header, catalogue, router);
 
+    return true;
+}
+
+void Serializator::LoadFlatCatalogue(const char* data, const flat::Header& header,
+    TransportCatalogue& catalogue) {
+
+    const auto strings = flat::GetSection<char>(data, header, flat::Section::STRINGS);
+    const size_t strings_size = strings.end() - strings.begin();
+
+    auto get_string = [&strings, strings_size](flat::String str) {
+        if (str.offset > strings_size || str.size > strings_size - str.offset) {
+            throw std::runtime_error("Broken string in the flat base file");
+        }
+        return std::string_view(strings.begin() + str.offset, str.size);
+    };
+
+    for (const auto& stop : flat::GetSection<flat::Stop>(data, header, flat::Section::STOPS)) {
+        catalogue.AddStop(get_string(stop.name), {stop.lat, stop.lng});
+    }
+
+    for (const auto& distance : flat::GetSection<flat::Distance>(data, header, flat::Section::DISTANCES)) {
+        catalogue.AddDistance(distance.from, distance.to, distance.length);
+    }
+
+    const auto bus_stops = flat::GetSection<uint32_t>(data, header, flat::Section::BUS_STOPS);
+    const size_t bus_stops_size = bus_stops.end() - bus_stops.begin();
+
+    for (const auto& bus : flat::GetSection<flat::Bus>(data, header, flat::Section::BUSES)) {
+        if (bus.first_stop > bus_stops_size || bus.stops_count > bus_stops_size - bus.first_stop) {
+            throw std::runtime_error("Broken bus in the flat base file");
+        }
+
+        const auto first_stop = bus_stops.begin() + bus.first_stop;
+        const std::vector<transport::StopId> stops(first_stop, first_stop + bus.stops_count);
+
+        catalogue.AddBus(get_string(bus.name), stops, bus.circular != 0,
+            {bus.all_stops, bus.unique_stops, bus.length, bus.curvature});
+    }
+    catalogue.Freeze();
+}
+
+// Таблица всех пар не копируется: маршрутизатор читает её из отображения файла
+void Serializator::LoadFlatTransportRouter(const std::shared_ptr<const MappedFile>& file,
+    const flat::Header& header, const TransportCatalogue& catalogue,
+    std::unique_ptr<route::TransportRouter>& transport_router) const {
+
+    using Router = route::TransportRouter::Router;
+    static_assert(std::is_same_v<Router::WeightValue, double>);
+
+    if (!proto_catalogue_.has_router()) {
+        return;
+    }
+
+    const char* data = file->GetData();
+
+    route::RouteSettings routing_settings;
+    LoadTransportRouterSettings(routing_settings);
+
+    transport_router = std::make_unique<route::TransportRouter>(catalogue, routing_settings);
+
+    const size_t vertex_count = proto_catalogue_.router().graph().vertex_count();
+    const size_t buses_count = catalogue.GetBusesSize();
+
+    std::vector<graph::Edge<route::RouteWeight>> edges;
+    for (const auto& edge : flat::GetSection<flat::Edge>(data, header, flat::Section::EDGES)) {
+        CheckIndex(edge.from, vertex_count, "Broken edge in the flat base file");
+        CheckIndex(edge.to, vertex_count, "Broken edge in the flat base file");
+        CheckIndex(edge.bus_id, buses_count, "Broken edge in the flat base file");
+
+        edges.push_back({edge.from, edge.to,
+            route::RouteWeight{catalogue.GetBusById(edge.bus_id), edge.total_time, edge.span_count}});
+    }
+
+    auto& router_graph = transport_router->GetGraph();
+    router_graph = route::TransportRouter::Graph(vertex_count, std::move(edges));
+
+    auto& router = transport_router->GetRouter();
+    router = std::make_unique<Router>(router_graph, routing_settings.router_mode, false);
+
+    if (routing_settings.router_mode == graph::RouterMode::ALL_PAIRS) {
+        const auto weights = flat::GetSection<double>(data, header, flat::Section::ROUTES_WEIGHTS);
+        const auto prev_edges = flat::GetSection<uint32_t>(data, header, flat::Section::ROUTES_PREV_EDGES);
+        const size_t cells_count = router_graph.GetVertexCount() * router_graph.GetVertexCount();
+
+        if (static_cast<size_t>(weights.end() - weights.begin()) != cells_count
+            || static_cast<size_t>(prev_edges.end() - prev_edges.begin()) != cells_count) {
+            throw std::runtime_error("Routes table size does not match the graph");
+        }
+
+        router->SetRoutesInternalDataView(weights.begin(), prev_edges.begin(), file);
+    } else if (routing_settings.router_mode == graph::RouterMode::CONTRACTION_HIERARCHY) {
+        auto& hierarchy = router->GetContractionHierarchy();
+
+        const auto ranks = flat::GetSection<uint32_t>(data, header, flat::Section::HIERARCHY_RANKS);
+        if (static_cast<size_t>(ranks.end() - ranks.begin()) != vertex_count) {
+            throw std::runtime_error("Contraction hierarchy size does not match the graph");
+        }
+        hierarchy.GetRanks().assign(ranks.begin(), ranks.end());
+
+        const auto flat_arcs = flat::GetSection<flat::Arc>(data, header, flat::Section::HIERARCHY_ARCS);
+
+        auto& arcs = hierarchy.GetArcs();
+        arcs.reserve(flat_arcs.end() - flat_arcs.begin());
+        for (const auto& flat_arc : flat_arcs) {
+            Router::Arc arc;
+
+            arc.from = flat_arc.from;
+            arc.to = flat_arc.to;
+            CheckIndex(arc.from, vertex_count, "Broken hierarchy arc in the flat base file");
+            CheckIndex(arc.to, vertex_count, "Broken hierarchy arc in the flat base file");
+
+            if (flat_arc.first != flat::NO_ARC) {
+                // шорткат ссылается только на предыдущие дуги, иначе его распаковка не закончится
+                CheckIndex(flat_arc.first, arcs.size(), "Broken hierarchy arc in the flat base file");
+                CheckIndex(flat_arc.second, arcs.size(), "Broken hierarchy arc in the flat base file");
+                arc.weight.total_time = flat_arc.total_time;
+                arc.first = flat_arc.first;
+                arc.second = flat_arc.second;
+            } else {
+                CheckIndex(flat_arc.edge_id, router_graph.GetEdgeCount(), "Broken hierarchy arc in the flat base file");
+                arc.edge_id = flat_arc.edge_id;
+                arc.weight = router_graph.GetEdge(arc.edge_id).weight;
+            }
+
+            arcs.push_back(std::move(arc));
+        }
+
+        hierarchy.BuildSearchIndex();
+    }
+
+    transport_router->InternalInit();
+}
 
 } // serialize
\ No newline at end of file
@@ -1,20 +1,32 @@
 #pragma once
 
 #include <filesystem>
+#include <memory>
+#include <ostream>
 #include <string>
 #include <unordered_map>
 
 #include <transport_catalogue.pb.h>
 
+#include "flat_format.h"
 #include "map_renderer.h"
+#include "mapped_file.h"
 #include "transport_catalogue.h"
 #include "transport_router.h"
 
 namespace serialize {
 
 
+enum class Format {
+    PROTOBUF, // сообщение protobuf, разбирается целиком при загрузке
+    FLAT,     // плоские массивы, отображаемые в память (flat_format.h)
+};
+
 struct Settings {
     std::filesystem::path file;
+    size_t threads = 1; // потоки для построения базы, 0 - по числу ядер
+    Format format = Format::PROTOBUF; // формат записи; при чтении определяется по файлу
+    bool store_map = false; // сохранить в базе готовую карту
 };
 
 
@@ -28,22 +40,35 @@ public:
     void SaveTransportCatalogue(const TransportCatalogue& catalogue);
     void SaveRenderSettings(transport::renderer::RenderSettings render_settings);
     void SaveTransportRouter(const route::TransportRouter &router);
+    void SaveMap(std::string map);
 
     bool Serialize();
 
     bool Deserialize(TransportCatalogue& catalogue, 
         std::optional<transport::renderer::RenderSettings>& result_settings, 
         std::unique_ptr<route::TransportRouter> &router);
+    // Карта, сохранённая в базе при make_base. Вызывается после Deserialize
+    std::optional<std::string> LoadMap();
 
 
 private:
+    void SerializeFlat(std::ostream& out) const;
+    bool DeserializeFlat(const std::shared_ptr<const MappedFile>& file, TransportCatalogue& catalogue,
+        std::optional<transport::renderer::RenderSettings>& result_settings,
+        std::unique_ptr<route::TransportRouter>& router);
+
+    void LoadFlatCatalogue(const char* data, const flat::Header& header, TransportCatalogue& catalogue);
+    void LoadFlatTransportRouter(const std::shared_ptr<const MappedFile>& file, const flat::Header& header,
+        const TransportCatalogue& catalogue, std::unique_ptr<route::TransportRouter>& transport_router) const;
+
     void SaveStops(const TransportCatalogue& catalogue);
     void LoadStops(TransportCatalogue& catalogue);
 
     void SaveBuses(const TransportCatalogue& catalogue);
     void LoadBuses(TransportCatalogue& catalogue);
 
-    void SaveBusStops(const transport::Bus& bus, proto_catalogue::Bus& proto_bus, const TransportCatalogue& catalogue);
+    static void SaveBusStops(const transport::Bus& bus, proto_catalogue::Bus& proto_bus);
+    static void SaveBusStat(const transport::BusStat& stat, proto_catalogue::Bus& proto_bus);
     void LoadBus(TransportCatalogue& catalogue, const proto_catalogue::Bus& proto_bus) const;
 
     void SaveDistances(const TransportCatalogue& catalogue);
@@ -54,6 +79,7 @@ private:
     void SaveTransportRouterSettings(const route::RouteSettings& routing_settings);
     void SaveGraph(const route::TransportRouter::Graph& graph);
     void SaveRouter(const std::unique_ptr<route::TransportRouter::Router>& router);
+    void SaveContractionHierarchy(const std::unique_ptr<route::TransportRouter::Router>& router);
 
     void LoadTransportRouter(const TransportCatalogue& catalogue,
         std::unique_ptr<route::TransportRouter>& transport_router);
@@ -62,6 +88,8 @@ private:
     void LoadGraph(const TransportCatalogue& catalogue, route::TransportRouter::Graph& graph);
     void LoadRouter(const TransportCatalogue& catalogue,
         std::unique_ptr<route::TransportRouter::Router>& router);
+    void LoadContractionHierarchy(const route::TransportRouter::Graph& graph,
+        std::unique_ptr<route::TransportRouter::Router>& router);
 
     proto_graph::RouteWeight MakeProtoWeight(const route::RouteWeight& weight) const;
     route::RouteWeight MakeWeight(const TransportCatalogue& catalogue,
@@ -70,16 +98,15 @@ private:
     static proto_catalogue::Coordinates MakeProtoCoordinates(const geo::Coordinates& coordinates);
     static proto_svg::Point MakeProtoPoint(const svg::Point& point);
     static proto_svg::Color MakeProtoColor(const svg::Color& color);
+    static proto_transport_router::RouterMode MakeProtoRouterMode(graph::RouterMode mode);
 
     static geo::Coordinates MakeCoordinates(const proto_catalogue::Coordinates& proto_coordinates);
     static svg::Point MakePoint(const proto_svg::Point& proto_point);
     static svg::Color MakeColor(const proto_svg::Color& proto_color);
+    static graph::RouterMode MakeRouterMode(proto_transport_router::RouterMode proto_mode);
 
     Settings settings_;
     ProtoTransportCatalogue proto_catalogue_;
-
-    std::unordered_map<int, std::string_view> bus_name_by_id_;
-    std::unordered_map<std::string_view, int> bus_id_by_name_;
 };
 
 } // serialize
\ No newline at end of file
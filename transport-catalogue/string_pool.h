@@ -0,0 +1,35 @@
+#pragma once
+
+#include <memory_resource>
+#include <string_view>
+#include <unordered_set>
+
+namespace transport {
+
+// Хранилище названий остановок и маршрутов. Каждое название хранится один раз
+// в общем буфере, который освобождается только вместе с пулом, поэтому
+// string_view, выданные Intern, действительны всё время жизни пула
+class StringPool {
+public:
+    StringPool() = default;
+    StringPool(const StringPool&) = delete;
+    StringPool& operator=(const StringPool&) = delete;
+
+    std::string_view Intern(std::string_view str) {
+        if (auto it = strings_.find(str); it != strings_.end()) {
+            return *it;
+        }
+
+        char* data = static_cast<char*>(arena_.allocate(str.size() + 1, alignof(char)));
+        str.copy(data, str.size());
+        data[str.size()] = '\0';
+
+        return *strings_.emplace(data, str.size()).first;
+    }
+
+private:
+    std::pmr::monotonic_buffer_resource arena_{1 << 16};
+    std::unordered_set<std::string_view> strings_;
+};
+
+} // transport
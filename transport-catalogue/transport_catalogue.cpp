@@ -1,6 +1,9 @@
 #include "transport_catalogue.h"
+#include "parallel.h"
 
+#include <algorithm>
 #include <iostream>
+#include <set>
 
 using namespace std;
 
@@ -10,21 +13,27 @@ int TransportCatalogue::GetStopsSize() const {
     return stopname_to_stop_.size();
 }
 
+int TransportCatalogue::GetBusesSize() const {
+    return static_cast<int>(buses_.size());
+}
+
 int TransportCatalogue::GetStopId(const std::string_view& name) const {
     return stopname_to_stop_.at(name)->id;
 }
 
 void TransportCatalogue::AddStop(const parsed::Stop& stop) {
-    int tmp_id = stop_id_;
+    AddStop(stop.name, geo::Coordinates{stop.lat, stop.lng});
+}
+
+void TransportCatalogue::AddStop(string_view name, geo::Coordinates coordinates) {
+    const auto id = static_cast<StopId>(stops_.size());
 
-    Stop s = Stop{stop.name, geo::Coordinates{stop.lat, stop.lng}, set<string_view>{}, stop_id_++};
-    
-    stops_.push_back(move(s));
+    stops_.push_back(Stop{names_.Intern(name), coordinates, {}, id});
 
     Stop* added = &stops_.back();
 
-    stopname_to_stop_[string_view{added->name}] = added;
-    stop_id_to_stop_[tmp_id] = added;
+    stopname_to_stop_[added->name] = added;
+    distances_.emplace_back();
 }
 
 void TransportCatalogue::AddDistances(const parsed::Distances& dists) {
@@ -33,32 +42,139 @@ void TransportCatalogue::AddDistances(const parsed::Distances& dists) {
     for (const auto& [dest, meters] : dists.d_map) {
         Stop* to = stopname_to_stop_.at(dest);
 
-        distances_[{from, to}] = meters;
+        AddDistance(from->id, to->id, meters);
 
-        if (distances_.count({to, from}) == 0) {
-            distances_[{to, from}] = meters;
+        if (!FindDistance(to->id, from->id)) {
+            AddDistance(to->id, from->id, meters);
         }
     }
 }
 
+void TransportCatalogue::AddDistance(StopId from, StopId to, int meters) {
+    if (from >= stops_.size() || to >= stops_.size()) {
+        throw out_of_range("wrong stop id"s);
+    }
+
+    auto& distances = distances_[from];
+    auto it = lower_bound(distances.begin(), distances.end(), to, [](const Distance& distance, StopId id) {
+        return distance.to < id;
+    });
+
+    if (it != distances.end() && it->to == to) {
+        it->meters = meters;
+    } else {
+        distances.insert(it, {to, meters});
+    }
+}
+
+// У остановки обычно несколько соседей, поэтому двоичный поиск по небольшому массиву
+const int* TransportCatalogue::FindDistance(StopId from, StopId to) const {
+    if (from >= distances_.size()) {
+        return nullptr;
+    }
+
+    const auto& distances = distances_[from];
+    auto it = lower_bound(distances.begin(), distances.end(), to, [](const Distance& distance, StopId id) {
+        return distance.to < id;
+    });
+
+    return it != distances.end() && it->to == to ? &it->meters : nullptr;
+}
+
 void TransportCatalogue::AddBus(const parsed::Bus& bus) {
+    Bus* added = InsertBus(bus);
+
+    bus_stats_[added->id] = CalculateStat(*added);
+}
+
+void TransportCatalogue::AddBus(const parsed::Bus& bus, const BusStat& stat) {
+    Bus* added = InsertBus(bus);
+
+    bus_stats_[added->id] = stat;
+}
+
+void TransportCatalogue::AddBus(string_view name, const vector<StopId>& stops, bool circular,
+    const BusStat& stat) {
+
+    vector<Stop*> bus_stops;
+    bus_stops.reserve(stops.size());
+
+    for (StopId id : stops) {
+        bus_stops.push_back(&stops_.at(id));
+    }
+
+    Bus* added = InsertBus(name, move(bus_stops), circular);
+
+    bus_stats_[added->id] = stat;
+}
+
+void TransportCatalogue::AddBuses(const vector<parsed::Bus>& buses, size_t threads_count) {
+    vector<Bus*> added;
+    added.reserve(buses.size());
+
+    for (const auto& bus : buses) {
+        added.push_back(InsertBus(bus));
+    }
+
+    vector<BusStat> stats(added.size());
+
+    parallel::ForEachChunk(added.size(), threads_count, [&](size_t begin, size_t end, size_t) {
+        for (size_t i = begin; i < end; ++i) {
+            stats[i] = CalculateStat(*added[i]);
+        }
+    });
+
+    for (size_t i = 0; i < added.size(); ++i) {
+        bus_stats_[added[i]->id] = stats[i];
+    }
+}
+
+// Маршрут может проходить через остановку несколько раз, повторы убираются здесь же
+void TransportCatalogue::Freeze() {
+    auto sort_unique = [](vector<string_view>& names) {
+        sort(names.begin(), names.end());
+        names.erase(unique(names.begin(), names.end()), names.end());
+        names.shrink_to_fit();
+    };
+
+    sort_unique(bus_names_);
+
+    for (Stop& stop : stops_) {
+        sort_unique(stop.buses_through);
+    }
+}
+
+Bus* TransportCatalogue::InsertBus(const parsed::Bus& bus) {
+    vector<Stop*> stops;
+    stops.reserve(bus.stops.size());
+
+    for (const string& el : bus.stops) {
+        stops.push_back(stopname_to_stop_.at(el));
+    }
+
+    return InsertBus(bus.name, move(stops), bus.circular);
+}
+
+Bus* TransportCatalogue::InsertBus(string_view name, vector<Stop*> stops, bool circular) {
     Bus b;
-    b.name = bus.name;
-    b.circular = bus.circular;
+    b.name = names_.Intern(name);
+    b.circular = circular;
+    b.bus_stops = move(stops);
+    b.id = static_cast<BusId>(buses_.size());
 
     buses_.push_back(move(b));
 
     Bus* added = &buses_.back();
-    bus_names_.insert(string_view{added->name});
+    bus_names_.push_back(added->name);
 
-    for (const string& el : bus.stops) {
-        added->bus_stops.push_back(stopname_to_stop_.at(el));
-        stopname_to_stop_.at(el)->buses_through.insert(string_view{added->name});
+    for (Stop* stop : added->bus_stops) {
+        stop->buses_through.push_back(added->name);
     }
 
-    busname_to_bus_[string_view{added->name}] = added;
+    busname_to_bus_[added->name] = added;
+    bus_stats_.emplace_back();
 
-    bus_stats_[string_view{added->name}] = CalculateStat(added->name);
+    return added;
 }
 
 bool TransportCatalogue::FindStop(const string& name) const {
@@ -69,32 +185,54 @@ bool TransportCatalogue::FindBus(const string& name) const {
     return busname_to_bus_.count(name) > 0;
 }
 
-optional<BusStat> TransportCatalogue::GetBusStat(const string& name) const {
-    if (bus_stats_.count(name) == 0) {
+optional<BusStat> TransportCatalogue::GetBusStat(string_view name) const {
+    auto it = busname_to_bus_.find(name);
+    if (it == busname_to_bus_.end()) {
         return nullopt;
     }
 
-    return bus_stats_.at(name);
+    return bus_stats_[it->second->id];
+}
+
+string_view TransportCatalogue::GetStopNameById(StopId id) const {
+    return stops_.at(id).name;
+}
+
+const Stop* TransportCatalogue::GetStopById(StopId id) const {
+    return &stops_.at(id);
+}
+
+const Bus* TransportCatalogue::GetBusById(BusId id) const {
+    return &buses_.at(id);
 }
 
-std::string TransportCatalogue::GetStopNameById(int id) const {
-    return stop_id_to_stop_.at(id)->name;
+const BusStat& TransportCatalogue::GetBusStatById(BusId id) const {
+    return bus_stats_.at(id);
 }
 
-set<string_view>* TransportCatalogue::GetBusesThroughStop(const string& name) const {
-    if (stopname_to_stop_.count(name) == 0) {
+const vector<string_view>* TransportCatalogue::GetBusesThroughStop(const string& name) const {
+    auto it = stopname_to_stop_.find(name);
+    if (it == stopname_to_stop_.end()) {
         return nullptr;
     }
 
-    return &stopname_to_stop_.at(name)->buses_through;
+    return &it->second->buses_through;
 }
 
 unsigned int TransportCatalogue::GetStopsDistance(const string& from, const string& dest) const {
-    return distances_.at({stopname_to_stop_.at(from), stopname_to_stop_.at(dest)});
+    return GetDistance(stopname_to_stop_.at(from)->id, stopname_to_stop_.at(dest)->id);
 }
 
+unsigned int TransportCatalogue::GetDistance(StopId from, StopId to) const {
+    const int* distance = FindDistance(from, to);
+    if (!distance) {
+        throw out_of_range("no distance between stops"s);
+    }
+    return *distance;
+}
 
-const set<string_view>* TransportCatalogue::GetBusNames() const {
+
+const vector<string_view>* TransportCatalogue::GetBusNames() const {
     return &bus_names_;
 }
 
@@ -102,20 +240,20 @@ const Bus* TransportCatalogue::GetBus(string_view name) const {
     return busname_to_bus_.at(name);
 }
 
-const std::unordered_map<std::string_view, Stop*> TransportCatalogue::GetStops() const {
+const std::unordered_map<std::string_view, Stop*>& TransportCatalogue::GetStops() const {
     return stopname_to_stop_;
 }
 
-const std::unordered_map<std::string_view, Bus*> TransportCatalogue::GetBuses() const {
+const std::unordered_map<std::string_view, Bus*>& TransportCatalogue::GetBuses() const {
     return busname_to_bus_;
 }
 
-const std::unordered_map<std::pair<Stop*, Stop*>, int, TransportCatalogue::DistanceHasher> TransportCatalogue::GetDistances() const {
-    return distances_;
+const vector<TransportCatalogue::Distance>& TransportCatalogue::GetDistancesFrom(StopId from) const {
+    return distances_.at(from);
 }
 
-BusStat TransportCatalogue::CalculateStat(const string& name) const {
-    Bus* b = busname_to_bus_.at(name);
+BusStat TransportCatalogue::CalculateStat(const Bus& bus) const {
+    const Bus* b = &bus;
 
     int stops_count = b->bus_stops.size();
     int unique_stops_count = 0;
@@ -139,7 +277,7 @@ BusStat TransportCatalogue::CalculateStat(const string& name) const {
         }
 
         geo_length += geo::ComputeDistance(b->bus_stops[i]->coordinates, b->bus_stops[i + 1]->coordinates);
-        actual_length += distances_.at({b->bus_stops[i], b->bus_stops[i + 1]});
+        actual_length += GetDistance(b->bus_stops[i]->id, b->bus_stops[i + 1]->id);
     }
 
     if (!b->circular) {
@@ -148,21 +286,11 @@ BusStat TransportCatalogue::CalculateStat(const string& name) const {
         --stops_count;
 
         for (size_t i = b->bus_stops.size() - 1; i > 0; --i) {
-            actual_length += distances_.at({b->bus_stops[i], b->bus_stops[i - 1]});
+            actual_length += GetDistance(b->bus_stops[i]->id, b->bus_stops[i - 1]->id);
         }
     }
 
     return BusStat{stops_count, unique_stops_count, actual_length, actual_length / geo_length};
 }
 
-size_t TransportCatalogue::DistanceHasher::operator()(const pair<Stop*, Stop*>& p) const {
-    size_t lat_1 = d_hasher_(p.first->coordinates.lat);
-    size_t lng_1 = d_hasher_(p.first->coordinates.lng);
-
-    size_t lat_2 = d_hasher_(p.second->coordinates.lat);
-    size_t lng_2 = d_hasher_(p.second->coordinates.lng);
-
-    return lat_1 + lng_1 * 37 + lat_2 * (37 * 37) + lng_2 * (37 * 37 * 37);
-}
-
 } // transport
\ No newline at end of file
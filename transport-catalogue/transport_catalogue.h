@@ -2,58 +2,77 @@
 
 #include <deque>
 #include <optional>
-#include <set>
 
 #include "domain.h"
+#include "string_pool.h"
 
 namespace transport {
 
 class TransportCatalogue {
-private:
-    struct DistanceHasher {
-        size_t operator()(const std::pair<Stop*, Stop*>& p) const;
-
-    private:
-        std::hash<double> d_hasher_;
+public:
+    struct Distance {
+        StopId to;
+        int meters;
     };
-    
 
-    int stop_id_ = 0;
+private:
+    StringPool names_;
+
+    // индекс в stops_ и buses_ совпадает с id
     std::deque<Stop> stops_;
     std::unordered_map<std::string_view, Stop*> stopname_to_stop_;
     
     std::deque<Bus> buses_;
-    std::set<std::string_view> bus_names_;
-    std::unordered_map<std::string_view, BusStat> bus_stats_;
+    std::vector<std::string_view> bus_names_;
+    std::vector<BusStat> bus_stats_;
     std::unordered_map<std::string_view, Bus*> busname_to_bus_;
 
-    std::unordered_map<int, Stop*> stop_id_to_stop_;
-
-    std::unordered_map<std::pair<Stop*, Stop*>, int, DistanceHasher> distances_;
+    // расстояния от каждой остановки, индекс - id остановки отправления,
+    // внутри отсортированы по id остановки назначения
+    std::vector<std::vector<Distance>> distances_;
 
-    BusStat CalculateStat(const std::string& name) const;
+    const int* FindDistance(StopId from, StopId to) const;
+    BusStat CalculateStat(const Bus& bus) const;
+    Bus* InsertBus(const parsed::Bus& bus);
+    Bus* InsertBus(std::string_view name, std::vector<Stop*> stops, bool circular);
     
 public:
     void AddStop(const parsed::Stop& stop);
+    void AddStop(std::string_view name, geo::Coordinates coordinates);
     void AddBus(const parsed::Bus& route);
+    // Добавляет маршрут с уже посчитанной статистикой, например прочитанной из базы
+    void AddBus(const parsed::Bus& route, const BusStat& stat);
+    // То же по id остановок, без поиска по названиям
+    void AddBus(std::string_view name, const std::vector<StopId>& stops, bool circular, const BusStat& stat);
+    // Добавляет маршруты и считает их статистику в threads_count потоках
+    void AddBuses(const std::vector<parsed::Bus>& buses, size_t threads_count);
     void AddDistances(const parsed::Distances& dists);
+    // Задаёт расстояние только в направлении from -> to
+    void AddDistance(StopId from, StopId to, int meters);
+    // Сортирует списки маршрутов справочника и остановок. Вызывается, когда все маршруты добавлены
+    void Freeze();
     
     bool FindStop(const std::string& name) const;
     bool FindBus(const std::string& name) const;
 
     int GetStopsSize() const;
+    int GetBusesSize() const;
     int GetStopId(const std::string_view& name) const;
-    std::string GetStopNameById(int id) const;
+    std::string_view GetStopNameById(StopId id) const;
+    const Stop* GetStopById(StopId id) const;
+    const Bus* GetBusById(BusId id) const;
+    const BusStat& GetBusStatById(BusId id) const;
 
-    const std::unordered_map<std::string_view, Stop*> GetStops() const;
-    const std::unordered_map<std::string_view, Bus*> GetBuses() const;
-    const std::unordered_map<std::pair<Stop*, Stop*>, int, DistanceHasher> GetDistances() const;
+    const std::unordered_map<std::string_view, Stop*>& GetStops() const;
+    const std::unordered_map<std::string_view, Bus*>& GetBuses() const;
+    const std::vector<Distance>& GetDistancesFrom(StopId from) const;
 
-    const std::set<std::string_view>* GetBusNames() const;
+    const std::vector<std::string_view>* GetBusNames() const;
     const Bus* GetBus(std::string_view name) const;
-    std::set<std::string_view>* GetBusesThroughStop(const std::string& name) const;
-    std::optional<BusStat> GetBusStat(const std::string& name) const;
+    const std::vector<std::string_view>* GetBusesThroughStop(const std::string& name) const;
+    std::optional<BusStat> GetBusStat(std::string_view name) const;
     unsigned int GetStopsDistance(const std::string& from, const std::string& dest) const;
+    unsigned int GetDistance(StopId from, StopId to) const;
 };
 
 } // transport
\ No newline at end of file
@@ -1,6 +1,12 @@
 #include "transport_router.h"
 
+#include "parallel.h"
+
+#include <algorithm>
+#include <cstdlib>
 #include <iostream>
+#include <iterator>
+#include <limits>
 
 namespace route {
 
@@ -8,14 +14,18 @@ TransportRouter::TransportRouter(const transport::TransportCatalogue& catalogue,
     const RouteSettings& settings) : catalogue_(catalogue), settings_(settings) {
 }
 
-void TransportRouter::InitRouter() {
+void TransportRouter::InitRouter(size_t threads_count) {
     if (!is_initialized_) {
-        graph::DirectedWeightedGraph<RouteWeight>graph(catalogue_.GetStopsSize());
-        graph_ = std::move(graph);
- 
-        BuildEdges();
+        if (settings_.graph_model == GraphModel::STOP_EVENTS) {
+            GraphBuilder graph(catalogue_.GetStopsSize() + CountRideVertices());
+            BuildStopEventEdges(graph);
+            graph_ = Graph(graph);
+        } else {
+            graph_ = Graph(catalogue_.GetStopsSize(), BuildEdges(threads_count));
+        }
 
-        router_ = std::make_unique<graph::Router<RouteWeight>>(graph_);
+        router_ = std::make_unique<Router>(graph_, settings_.router_mode, true, threads_count);
+        SetupHeuristic();
         is_initialized_ = true;
     }
 }
@@ -26,11 +36,18 @@ TransportRouter::BuildRoute(const std::string& from, const std::string& to) {
         return TransportRoute{};
     }
 
+    return BuildRoute(catalogue_.GetStopId(from), catalogue_.GetStopId(to));
+}
+
+std::optional<TransportRouter::TransportRoute>
+TransportRouter::BuildRoute(transport::StopId from, transport::StopId to) {
+    if (from == to) {
+        return TransportRoute{};
+    }
+
     InitRouter();
 
-    auto from_id = catalogue_.GetStopId(from);
-    auto to_id = catalogue_.GetStopId(to);
-    auto route = router_->BuildRoute(from_id, to_id);
+    auto route = router_->BuildRoute(from, to);
     
     if (!route) {
         return std::nullopt;
@@ -38,10 +55,35 @@ TransportRouter::BuildRoute(const std::string& from, const std::string& to) {
 
     TransportRoute result;
 
+    if (settings_.graph_model == GraphModel::STOP_EVENTS) {
+        // путь имеет вид: посадка (остановка -> поездка), перегоны, высадка (поездка -> остановка)
+        const graph::VertexId stops_count = catalogue_.GetStopsSize();
+        RouterEdge route_edge;
+
+        for (auto edge_id : route->edges) {
+            const auto &edge = graph_.GetEdge(edge_id);
+
+            if (edge.from < stops_count) {
+                route_edge = RouterEdge{};
+                route_edge.bus_name = edge.weight.bus->name;
+                route_edge.stop_from = catalogue_.GetStopNameById(edge.from);
+            }
+
+            route_edge.span_count += edge.weight.span_count;
+            route_edge.total_time += edge.weight.total_time;
+
+            if (edge.to < stops_count) {
+                route_edge.stop_to = catalogue_.GetStopNameById(edge.to);
+                result.push_back(route_edge);
+            }
+        }
+        return result;
+    }
+
     for (auto edge_id : route->edges) {
         const auto &edge = graph_.GetEdge(edge_id);
         RouterEdge route_edge;
-        route_edge.bus_name = edge.weight.bus_name;
+        route_edge.bus_name = edge.weight.bus->name;
         route_edge.stop_from = catalogue_.GetStopNameById(edge.from);
         route_edge.stop_to = catalogue_.GetStopNameById(edge.to);
         route_edge.span_count = edge.weight.span_count;
@@ -61,6 +103,7 @@ RouteSettings& TransportRouter::GetSettings() {
 }
 
 void TransportRouter::InternalInit() {
+    SetupHeuristic();
     is_initialized_ = true;
 }
 
@@ -79,53 +122,204 @@ const std::unique_ptr<TransportRouter::Router>& TransportRouter::GetRouter() con
 }
 
 
-void TransportRouter::BuildEdges() {
+// Нижняя оценка времени в пути: расстояние по прямой, умноженное на наименьшее
+// отношение дорожного расстояния к прямому среди всех перегонов, делённое на скорость.
+// По неравенству треугольника такая оценка не превышает время любого маршрута
+void TransportRouter::SetupHeuristic() {
+    if (!router_ || router_->GetMode() != graph::RouterMode::A_STAR) {
+        return;
+    }
+
+    vertex_coordinates_.assign(graph_.GetVertexCount(), geo::Coordinates{});
+    for (const auto& [stop_name, stop] : catalogue_.GetStops()) {
+        vertex_coordinates_[stop->id] = stop->coordinates;
+    }
+
+    // вершина поездки находится там же, где остановка, на которой в неё садятся или из неё выходят
+    const graph::VertexId stops_count = catalogue_.GetStopsSize();
+    for (const auto& edge : graph_.GetEdges()) {
+        if (edge.from < stops_count && edge.to >= stops_count) {
+            vertex_coordinates_[edge.to] = vertex_coordinates_[edge.from];
+        } else if (edge.from >= stops_count && edge.to < stops_count) {
+            vertex_coordinates_[edge.from] = vertex_coordinates_[edge.to];
+        }
+    }
+
+    double min_ratio = std::numeric_limits<double>::max();
     for (const auto& [bus_name, bus] : catalogue_.GetBuses()) {
-        int stops_count = static_cast<int>(bus->bus_stops.size());
-
-        for(int i = 0; i < stops_count - 1; ++i) {
-
-            double route_time = settings_.bus_wait_time;
-            double route_time_back = settings_.bus_wait_time;
-
-            for(int j = i + 1; j < stops_count; ++j) {
-                graph::Edge<RouteWeight> edge = BuildEdge(bus, i, j);
-                route_time += ComputeTime(bus, j - 1, j);
-                edge.weight.total_time = route_time;
-                graph_.AddEdge(edge);
-
-                if (!bus->circular) {
-                    int i_back = stops_count - 1 - i;
-                    int j_back = stops_count - 1 - j;
-                    
-                    graph::Edge<RouteWeight> edge = BuildEdge(bus, i_back, j_back);
-                    
-                    route_time_back += ComputeTime(bus, j_back + 1, j_back);
-                    edge.weight.total_time = route_time_back;
-                    graph_.AddEdge(edge);
-                }
+        for (size_t i = 1; i < bus->bus_stops.size(); ++i) {
+            const Stop* prev = bus->bus_stops[i - 1];
+            const Stop* cur = bus->bus_stops[i];
+            const double geo_distance = geo::ComputeDistance(prev->coordinates, cur->coordinates);
+
+            if (geo_distance <= 0) {
+                continue;
             }
+
+            min_ratio = std::min(min_ratio, catalogue_.GetDistance(prev->id, cur->id) / geo_distance);
+            if (!bus->circular) {
+                min_ratio = std::min(min_ratio, catalogue_.GetDistance(cur->id, prev->id) / geo_distance);
+            }
+        }
+    }
+
+    if (min_ratio == std::numeric_limits<double>::max()) {
+        return;
+    }
+
+    const double meters_per_minute = settings_.bus_velocity * 1000.0 / 60.0;
+    const double factor = min_ratio / meters_per_minute;
+
+    router_->SetHeuristic([this, factor](graph::VertexId from, graph::VertexId to) {
+        RouteWeight estimation;
+        estimation.total_time =
+            geo::ComputeDistance(vertex_coordinates_[from], vertex_coordinates_[to]) * factor;
+        return estimation;
+    });
+}
+
+// Рёбра каждого автобуса строятся независимо, поэтому автобусы делятся между потоками,
+// а рёбра собираются из буферов потоков в исходном порядке
+std::vector<graph::Edge<RouteWeight>> TransportRouter::BuildEdges(size_t threads_count) const {
+    std::vector<const transport::Bus*> buses;
+    for (const auto& [bus_name, bus] : catalogue_.GetBuses()) {
+        buses.push_back(bus);
+    }
+
+    std::vector<std::vector<graph::Edge<RouteWeight>>> parts(
+        parallel::ChunksCount(buses.size(), threads_count));
+
+    parallel::ForEachChunk(buses.size(), threads_count, [&](size_t begin, size_t end, size_t part) {
+        for (size_t i = begin; i < end; ++i) {
+            AddBusEdges(buses[i], parts[part]);
+        }
+    });
+
+    size_t edges_count = 0;
+    for (const auto& part : parts) {
+        edges_count += part.size();
+    }
+
+    std::vector<graph::Edge<RouteWeight>> edges;
+    edges.reserve(edges_count);
+
+    for (auto& part : parts) {
+        std::move(part.begin(), part.end(), std::back_inserter(edges));
+    }
+
+    return edges;
+}
+
+void TransportRouter::AddBusEdges(const transport::Bus* bus,
+    std::vector<graph::Edge<RouteWeight>>& edges) const {
+
+    int stops_count = static_cast<int>(bus->bus_stops.size());
+
+    for(int i = 0; i < stops_count - 1; ++i) {
+
+        double route_time = settings_.bus_wait_time;
+        double route_time_back = settings_.bus_wait_time;
+
+        for(int j = i + 1; j < stops_count; ++j) {
+            graph::Edge<RouteWeight> edge = BuildEdge(bus, i, j);
+            route_time += ComputeTime(bus, j - 1, j);
+            edge.weight.total_time = route_time;
+            edges.push_back(edge);
+
+            if (!bus->circular) {
+                int i_back = stops_count - 1 - i;
+                int j_back = stops_count - 1 - j;
+                
+                graph::Edge<RouteWeight> edge = BuildEdge(bus, i_back, j_back);
+                
+                route_time_back += ComputeTime(bus, j_back + 1, j_back);
+                edge.weight.total_time = route_time_back;
+                edges.push_back(edge);
+            }
+        }
+    }
+}
+
+size_t TransportRouter::CountRideVertices() const {
+    size_t count = 0;
+
+    for (const auto& [bus_name, bus] : catalogue_.GetBuses()) {
+        if (bus->bus_stops.size() < 2) {
+            continue;
+        }
+        count += bus->bus_stops.size() * (bus->circular ? 1 : 2);
+    }
+
+    return count;
+}
+
+// Для каждой остановки маршрута создаётся вершина поездки. Посадка стоит времени ожидания,
+// перегон между соседними вершинами поездки - времени в пути, высадка бесплатна.
+// Так число рёбер линейно зависит от длины маршрута, а ответы совпадают с моделью пар остановок
+void TransportRouter::BuildStopEventEdges(GraphBuilder& graph) {
+    graph::VertexId next_ride_vertex = catalogue_.GetStopsSize();
+
+    for (const auto& [bus_name, bus] : catalogue_.GetBuses()) {
+        const int stops_count = static_cast<int>(bus->bus_stops.size());
+        if (stops_count < 2) {
+            continue;
+        }
+
+        std::vector<int> stop_indices(stops_count);
+        for (int i = 0; i < stops_count; ++i) {
+            stop_indices[i] = i;
+        }
+
+        AddRideEdges(graph, bus, stop_indices, next_ride_vertex);
+        next_ride_vertex += stops_count;
+
+        if (!bus->circular) {
+            std::reverse(stop_indices.begin(), stop_indices.end());
+            AddRideEdges(graph, bus, stop_indices, next_ride_vertex);
+            next_ride_vertex += stops_count;
+        }
+    }
+}
+
+void TransportRouter::AddRideEdges(GraphBuilder& graph, const transport::Bus* bus,
+    const std::vector<int>& stop_indices, graph::VertexId first_ride_vertex) {
+
+    const size_t stops_count = stop_indices.size();
+
+    for (size_t i = 0; i < stops_count; ++i) {
+        const graph::VertexId stop_vertex = bus->bus_stops[stop_indices[i]]->id;
+        const graph::VertexId ride_vertex = first_ride_vertex + i;
+
+        if (i + 1 < stops_count) {
+            graph.AddEdge({stop_vertex, ride_vertex,
+                RouteWeight{bus, static_cast<double>(settings_.bus_wait_time), 0}});
+            graph.AddEdge({ride_vertex, ride_vertex + 1,
+                RouteWeight{bus, ComputeTime(bus, stop_indices[i], stop_indices[i + 1]), 1}});
+        }
+
+        if (i > 0) {
+            graph.AddEdge({ride_vertex, stop_vertex, RouteWeight{bus, 0, 0}});
         }
     }
 }
 
 graph::Edge<RouteWeight> TransportRouter::BuildEdge(const transport::Bus* bus,
-    int stop_from_index, int stop_to_index) {
+    int stop_from_index, int stop_to_index) const {
 
     graph::Edge<RouteWeight> edge;
     
-    edge.from = catalogue_.GetStopId(bus->bus_stops.at(static_cast<size_t>(stop_from_index))->name);
-    edge.to = catalogue_.GetStopId(bus->bus_stops.at(static_cast<size_t>(stop_to_index))->name);
+    edge.from = bus->bus_stops[static_cast<size_t>(stop_from_index)]->id;
+    edge.to = bus->bus_stops[static_cast<size_t>(stop_to_index)]->id;
     
-    edge.weight.bus_name = bus->name;
-    edge.weight.span_count = static_cast<int>(stop_to_index - stop_from_index);
+    edge.weight.bus = bus;
+    edge.weight.span_count = std::abs(stop_to_index - stop_from_index);
     
     return edge;
 }
 
-double TransportRouter::ComputeTime(const transport::Bus* bus, int stop_from_index, int stop_to_index) {
-    auto distance = catalogue_.GetStopsDistance(bus->bus_stops.at(static_cast<size_t>(stop_from_index))->name,
-        bus->bus_stops.at(static_cast<size_t>(stop_to_index))->name);
+double TransportRouter::ComputeTime(const transport::Bus* bus, int stop_from_index, int stop_to_index) const {
+    auto distance = catalogue_.GetDistance(bus->bus_stops[static_cast<size_t>(stop_from_index)]->id,
+        bus->bus_stops[static_cast<size_t>(stop_to_index)]->id);
     
     return distance / (settings_.bus_velocity * 1000.0 / 60.0);
 }
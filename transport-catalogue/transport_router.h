@@ -18,30 +18,60 @@ using namespace transport;
 using namespace std::literals;
 
 struct RouteWeight {
-	std::string_view bus_name;
+	const transport::Bus* bus = nullptr;
 	double total_time = 0;
 	int span_count = 0;
 };
 
+enum class GraphModel {
+	STOP_PAIRS,  // ребро для каждой пары остановок каждого автобуса, O(n^2) на маршрут
+	STOP_EVENTS, // вершины ожидания на остановках и вершины поездки, O(n) на маршрут
+};
+
 struct RouteSettings {
 	int bus_wait_time = 0;
 	int bus_velocity = 0;
+	graph::RouterMode router_mode = graph::RouterMode::ALL_PAIRS;
+	GraphModel graph_model = GraphModel::STOP_PAIRS;
 };
 
 bool operator<(const RouteWeight& left, const RouteWeight& right);
 bool operator>(const RouteWeight& left, const RouteWeight& right);
 RouteWeight operator+(const RouteWeight& left, const RouteWeight& right);
 
+} // namespace route
+
+namespace graph {
+
+// В таблице всех пар достаточно хранить время в пути
+template <>
+struct RouteTableTraits<route::RouteWeight> {
+    using Value = double;
+
+    static Value ToValue(const route::RouteWeight& weight) {
+        return weight.total_time;
+    }
+    static route::RouteWeight FromValue(Value value) {
+        return route::RouteWeight{nullptr, value, 0};
+    }
+};
+
+} // namespace graph
+
+namespace route {
+
 class TransportRouter {
 public:
 
-    using Graph = graph::DirectedWeightedGraph<RouteWeight>;
-    using Router = graph::Router<RouteWeight>;
+    using GraphBuilder = graph::DirectedWeightedGraph<RouteWeight>;
+    using Graph = graph::FrozenDirectedWeightedGraph<RouteWeight>;
+    using Router = graph::Router<RouteWeight, Graph>;
 
+    // Названия указывают в пул строк справочника
     struct RouterEdge {
-        std::string bus_name;
-        std::string stop_from;
-        std::string stop_to;
+        std::string_view bus_name;
+        std::string_view stop_from;
+        std::string_view stop_to;
         double total_time = 0;
         int span_count = 0;
     };
@@ -51,11 +81,12 @@ public:
         const RouteSettings& settings);
 
     std::optional<TransportRoute> BuildRoute(const std::string& from, const std::string& to);
+    std::optional<TransportRoute> BuildRoute(transport::StopId from, transport::StopId to);
 
     const RouteSettings& GetSettings() const;
     RouteSettings& GetSettings();
 
-    void InitRouter();
+    void InitRouter(size_t threads_count = 1);
     void InternalInit();
 
     Graph& GetGraph();
@@ -73,9 +104,17 @@ private:
     Graph graph_;
     mutable std::unique_ptr<Router> router_;
 
-    void BuildEdges();
-    graph::Edge<RouteWeight> BuildEdge(const transport::Bus* bus, int stop_from_index, int stop_to_index);
-    double ComputeTime(const transport::Bus* bus, int stop_from_index, int stop_to_index);
+    std::vector<geo::Coordinates> vertex_coordinates_;
+
+    void SetupHeuristic();
+    size_t CountRideVertices() const;
+    std::vector<graph::Edge<RouteWeight>> BuildEdges(size_t threads_count) const;
+    void AddBusEdges(const transport::Bus* bus, std::vector<graph::Edge<RouteWeight>>& edges) const;
+    void BuildStopEventEdges(GraphBuilder& graph);
+    void AddRideEdges(GraphBuilder& graph, const transport::Bus* bus,
+        const std::vector<int>& stop_indices, graph::VertexId first_ride_vertex);
+    graph::Edge<RouteWeight> BuildEdge(const transport::Bus* bus, int stop_from_index, int stop_to_index) const;
+    double ComputeTime(const transport::Bus* bus, int stop_from_index, int stop_to_index) const;
 };
 
 } 
\ No newline at end of file